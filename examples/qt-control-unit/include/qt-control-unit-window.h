@@ -12,7 +12,9 @@
   #define __VIJFENDERTIG__QT_CONTROL_UNIT__QT_CONTROL_UNIT_WINDOW
 
 
+  #include <chrono>
   #include <iostream>
+  #include <QtCore/QTimer>
   #include <QtGui/QMainWindow>
 
   #include <robotic-arm-usb.h>
@@ -58,10 +60,19 @@
         void on_button_light_off_pressed();
         void on_button_light_on_pressed();
 
+      private Q_SLOTS:
+
+        void updateTelemetry();
+
       private:
 
+        static const int telemetry_interval_ms{250};
+
         Ui::main_window ui;
         RoboticArmUsb robotic_arm;
+        QTimer telemetry_timer;
+        RoboticArmUsb::Statistics telemetry_statistics;
+        std::chrono::steady_clock::time_point telemetry_time;
 
         void setStatusMessage(std::string status);
     };
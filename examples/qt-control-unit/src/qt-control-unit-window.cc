@@ -14,10 +14,17 @@ namespace vijfendertig {
 
   QtControlUnitWindow::QtControlUnitWindow(int argc, char ** argv, QWidget * parent):
     QMainWindow(parent),
-    robotic_arm{}
+    robotic_arm{},
+    telemetry_timer{},
+    telemetry_statistics(robotic_arm.getStatistics()),
+    telemetry_time{std::chrono::steady_clock::now()}
   {
     ui.setupUi(this);
     setFixedSize(size());
+    // Refresh the telemetry at a fixed rate from the library's lock-free statistics, so a
+    // degrading USB link shows up without any work per command.
+    connect(&telemetry_timer, SIGNAL(timeout()), this, SLOT(updateTelemetry()));
+    telemetry_timer.start(telemetry_interval_ms);
   }
 
   QtControlUnitWindow::~QtControlUnitWindow()
@@ -199,6 +206,38 @@ namespace vijfendertig {
     setStatusMessage(robotic_arm.getStatusString(status));
   }
 
+  void QtControlUnitWindow::updateTelemetry()
+  {
+    auto statistics = robotic_arm.getStatistics();
+    auto time = std::chrono::steady_clock::now();
+    double interval = std::chrono::duration<double>(time - telemetry_time).count();
+    uint64_t commands = statistics.commands - telemetry_statistics.commands;
+    uint64_t transfers = statistics.transfers - telemetry_statistics.transfers;
+    uint64_t errors = statistics.transfer_errors - telemetry_statistics.transfer_errors;
+    RoboticArmUsb::LatencyHistogram latency;
+    for(std::size_t bucket = 0; bucket < latency.size(); ++ bucket) {
+      latency[bucket] = statistics.transfer_latency[bucket]
+        - telemetry_statistics.transfer_latency[bucket];
+    }
+    ui.label_telemetry_commands->setText(QString::number(commands / interval, 'f', 1));
+    ui.label_telemetry_errors->setText(QString::number(errors / interval, 'f', 1));
+    if(transfers > 0) {
+      ui.label_telemetry_coalescing->setText(
+          QString::number(double(commands) / transfers, 'f', 2));
+      ui.label_telemetry_latency->setText(QString("< %1 / < %2 us")
+          .arg(RoboticArmUsb::getLatencyPercentile(latency, 50.0).count())
+          .arg(RoboticArmUsb::getLatencyPercentile(latency, 99.0).count()));
+    }
+    else {
+      ui.label_telemetry_coalescing->setText("-");
+      ui.label_telemetry_latency->setText("-");
+    }
+    ui.label_telemetry_command_state->setText(
+        QString("0x%1").arg(statistics.command_state, 6, 16, QChar('0')));
+    telemetry_statistics = statistics;
+    telemetry_time = time;
+  }
+
   void QtControlUnitWindow::setStatusMessage(std::string message)
   {
     message[0] = std::toupper(message[0]);
@@ -0,0 +1,124 @@
+//! Emergency stop stress test for the Velleman/OWI Robotic Arm's C++11 interface.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#include <robotic-arm-usb.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+using namespace vijfendertig;
+
+
+int main(int argc, char ** argv)
+{
+  // Usage: test-emergency-stop [producers [stops [bound in ms]]]
+  std::size_t producer_count = argc > 1 ? std::stoul(argv[1]) : 8;
+  std::size_t stop_count = argc > 2 ? std::stoul(argv[2]) : 100;
+  std::chrono::milliseconds bound{argc > 3 ? std::stol(argv[3]) : 20};
+
+  RoboticArmUsb robotic_arm;
+  RoboticArmUsb::Status status;
+
+  std::cerr << "connect" << std::endl;
+  status = robotic_arm.connect();
+  std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
+  if(status != RoboticArmUsb::Status::kConnected) {
+    return EXIT_FAILURE;
+  }
+
+  // Flood the library with commands (only the LED, so the arm doesn't move) from several threads.
+  std::atomic<bool> running{true};
+  std::atomic<uint64_t> command_count{0};
+  std::vector<std::thread> producers;
+  for(std::size_t producer = 0; producer < producer_count; ++ producer) {
+    producers.emplace_back([&robotic_arm, &running, &command_count, producer]{
+        std::minstd_rand random{static_cast<std::minstd_rand::result_type>(producer + 1)};
+        while(running) {
+          robotic_arm.sendCommand(RoboticArmUsb::Actuator::kLight,
+              random() % 2 ? RoboticArmUsb::Action::kOn : RoboticArmUsb::Action::kOff);
+          ++ command_count;
+        }
+      });
+  }
+
+  // Engage and release the emergency stop while the producers are running.
+  std::cerr << "emergencyStop (" << stop_count << " times, " << producer_count << " producers)"
+    << std::endl;
+  // A stop command which isn't sent within a second (e.g. because the transfer failed) fails the
+  // test instead of hanging it.
+  bool stopped{true};
+  for(std::size_t stop = 0; stop < stop_count && stopped; ++ stop) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    robotic_arm.emergencyStop();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    while(robotic_arm.getEmergencyStopStatistics().count <= stop) {
+      if(std::chrono::steady_clock::now() > deadline) {
+        std::cerr << "            ==> stop " << stop << " wasn't sent within a second" << std::endl;
+        stopped = false;
+        break;
+      }
+      std::this_thread::yield();
+    }
+    robotic_arm.releaseEmergencyStop();
+  }
+  running = false;
+  for(auto & producer: producers) {
+    producer.join();
+  }
+  auto statistics = robotic_arm.getEmergencyStopStatistics();
+  std::cerr << "            ==> " << statistics.count << " stops, " << command_count
+    << " commands, worst latency "
+    << std::chrono::duration_cast<std::chrono::microseconds>(statistics.max_latency).count()
+    << " us (bound " << bound.count() << " ms)" << std::endl;
+
+  // Releasing the emergency stop mustn't restart a motor which was running when it was engaged.
+  // Run the gripper (it only moves for a few ms), engage and release the emergency stop and
+  // switch on the light: no transfer after the emergency stop may contain a motor bit.
+  bool restarted{false};
+  if(stopped) {
+    std::cerr << "emergencyStop (after a motor command), releaseEmergencyStop, light on"
+      << std::endl;
+    const uint32_t light_mask{uint32_t(0x03) << uint8_t(RoboticArmUsb::Actuator::kLight)};
+    auto waitForTransfer = [&robotic_arm](uint32_t mask) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while((robotic_arm.getStatistics().command_state & mask) == 0
+            && std::chrono::steady_clock::now() < deadline) {
+          std::this_thread::yield();
+        }
+      };
+    robotic_arm.getEventDescriptor();
+    robotic_arm.sendCommand(RoboticArmUsb::Actuator::kGripper, RoboticArmUsb::Action::kOpen);
+    waitForTransfer(~ light_mask);
+    robotic_arm.pollEvents();
+    robotic_arm.emergencyStop();
+    robotic_arm.releaseEmergencyStop();
+    robotic_arm.sendCommand(RoboticArmUsb::Actuator::kLight, RoboticArmUsb::Action::kOn);
+    waitForTransfer(light_mask);
+    for(const auto & event: robotic_arm.pollEvents()) {
+      if(event.type == RoboticArmUsb::EventType::kTransferCompleted
+          && (event.command_state & ~ light_mask) != 0) {
+        restarted = true;
+      }
+    }
+    std::cerr << "            ==> " << (restarted ? "motor restarted" : "motors stopped")
+      << std::endl;
+  }
+
+  std::cerr << "disconnect" << std::endl;
+  status = robotic_arm.disconnect();
+  std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
+
+  return stopped && !restarted && statistics.max_latency <= bound ? EXIT_SUCCESS : EXIT_FAILURE;
+}
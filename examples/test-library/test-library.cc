@@ -8,8 +8,11 @@
 
 
 #include <robotic-arm-usb.h>
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
 #include <thread>
 
 
@@ -18,7 +21,27 @@ using namespace vijfendertig;
 
 int main(int argc, char ** argv)
 {
-  RoboticArmUsb robotic_arm;
+  // Usage: test-library [--virtual-clock]
+  // With a virtual clock, the pauses between the steps take no time: a separate thread advances
+  // the clock as soon as the main thread sleeps on it.
+  bool virtual_clock = argc > 1 && std::string(argv[1]) == "--virtual-clock";
+  std::shared_ptr<RoboticArmVirtualClock> clock;
+  std::atomic<bool> finished{false};
+  std::thread clock_driver;
+  if(virtual_clock) {
+    clock = std::make_shared<RoboticArmVirtualClock>();
+    clock_driver = std::thread{[&clock, &finished]() {
+      while(!finished) {
+        if(clock->getWaiterCount() > 0) {
+          clock->advance(std::chrono::seconds(1));
+        }
+        else {
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+      }
+    }};
+  }
+  RoboticArmUsb robotic_arm{clock ? clock : RoboticArmClock::getSystemClock()};
   RoboticArmUsb::Status status;
 
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
@@ -28,42 +51,42 @@ int main(int argc, char ** argv)
   status = robotic_arm.connect();
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Connect again. This should notice we're already connected and just return 'connected'.
   std::cerr << "connect     (again, should be ignored if the previous call succeeded)" << std::endl;
   status = robotic_arm.connect();
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Turn on the LED.
   std::cerr << "sendCommand (LED on)" << std::endl;
   status = robotic_arm.sendCommand(RoboticArmUsb::Actuator::kLight, RoboticArmUsb::Action::kOn);
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Turn off the LED.
   std::cerr << "sendCommand (LED off)" << std::endl;
   status = robotic_arm.sendCommand(RoboticArmUsb::Actuator::kLight, RoboticArmUsb::Action::kOff);
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Turn on the LED.
   std::cerr << "sendCommand (LED on)" << std::endl;
   status = robotic_arm.sendCommand(RoboticArmUsb::Actuator::kLight, RoboticArmUsb::Action::kOn);
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Disconnect. This should turn off the LED too. 
   std::cerr << "disconnect  (and turn LED off on disconnect)" << std::endl;
   status = robotic_arm.disconnect();
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
-  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  robotic_arm.getClock().sleepFor(std::chrono::milliseconds(1000));
   std::cerr << std::endl;
   // Disconnect again. This should notice we're not connected and just return 'disconnected'.
   std::cerr << "disconnect  (again, should be ignored)" << std::endl;
@@ -71,5 +94,10 @@ int main(int argc, char ** argv)
   std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
   std::cerr << "getState    ==> '" << robotic_arm.getStatusString(robotic_arm.getStatus()) << "'" << std::endl;
 
+  if(virtual_clock) {
+    finished = true;
+    clock_driver.join();
+  }
+
   return EXIT_SUCCESS;
 }
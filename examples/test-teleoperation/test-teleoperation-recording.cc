@@ -0,0 +1,100 @@
+//! Recorded teleoperation check for the Velleman/OWI Robotic Arm's C++11 interface.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#include <robotic-arm-teleoperation.h>
+#include <robotic-arm-usb.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+
+using namespace vijfendertig;
+
+
+int main(int argc, char ** argv)
+{
+  // Usage: test-teleoperation-recording <recorded events (text)>
+  if(argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <recorded events (text)>" << std::endl;
+    return EXIT_FAILURE;
+  }
+  // Convert the text fixture into a raw recording (input_event structures, as read from a
+  // device), which keeps the fixture independent of the platform's input_event layout.
+  std::ifstream fixture{argv[1]};
+  if(!fixture) {
+    std::cerr << "Can't open '" << argv[1] << "'." << std::endl;
+    return EXIT_FAILURE;
+  }
+  char recording_path[] = "/tmp/test-teleoperation-recording.XXXXXX";
+  int descriptor = mkstemp(recording_path);
+  if(descriptor < 0) {
+    std::cerr << "Can't create a temporary recording." << std::endl;
+    return EXIT_FAILURE;
+  }
+  uint64_t expected_submissions{0};
+  std::string line;
+  while(std::getline(fixture, line)) {
+    std::istringstream fields{line};
+    std::string keyword;
+    if(!(fields >> keyword) || keyword[0] == '#') {
+      continue;
+    }
+    if(keyword == "expect") {
+      fields >> expected_submissions;
+      continue;
+    }
+    struct input_event event{};
+    event.type = std::stoi(keyword);
+    int code, value;
+    fields >> code >> value;
+    event.code = code;
+    event.value = value;
+    if(write(descriptor, &event, sizeof(event)) != sizeof(event)) {
+      std::cerr << "Can't write the temporary recording." << std::endl;
+      close(descriptor);
+      std::remove(recording_path);
+      return EXIT_FAILURE;
+    }
+  }
+  close(descriptor);
+
+  // Replay it without a robotic arm: only count the submissions.
+  RoboticArmTeleoperation teleoperation{[](const RoboticArmTeleoperation::Commands &) {
+    return RoboticArmUsb::Status::kConnected;
+  }};
+  teleoperation.addAxis(RoboticArmTeleoperation::AxisMapping{ABS_X,
+      RoboticArmUsb::Actuator::kBase, RoboticArmUsb::Action::kCW, 0, 8192, 2048});
+  teleoperation.addAxis(RoboticArmTeleoperation::AxisMapping{ABS_Y,
+      RoboticArmUsb::Actuator::kShoulder, RoboticArmUsb::Action::kDown, 0, 8192, 2048});
+  teleoperation.addButton(RoboticArmTeleoperation::ButtonMapping{BTN_SOUTH,
+      RoboticArmUsb::Actuator::kGripper, RoboticArmUsb::Action::kClose});
+  teleoperation.addButton(RoboticArmTeleoperation::ButtonMapping{BTN_EAST,
+      RoboticArmUsb::Actuator::kGripper, RoboticArmUsb::Action::kOpen});
+  auto status = teleoperation.play(recording_path);
+  std::remove(recording_path);
+
+  auto statistics = teleoperation.getStatistics();
+  std::cerr << "play (" << argv[1] << ")" << std::endl;
+  std::cerr << "            ==> '" << RoboticArmUsb::getStatusString(status) << "', "
+    << statistics.events << " events, " << statistics.reports << " reports, "
+    << statistics.submissions << " submissions (expected " << expected_submissions
+    << "), suppression ratio " << RoboticArmTeleoperation::getSuppressionRatio(statistics)
+    << ", worst latency "
+    << std::chrono::duration_cast<std::chrono::microseconds>(statistics.max_latency).count()
+    << " us" << std::endl;
+  bool success = status == RoboticArmUsb::Status::kConnected
+    && statistics.submissions == expected_submissions;
+  std::cerr << (success ? "passed" : "failed") << std::endl;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
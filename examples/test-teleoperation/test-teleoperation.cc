@@ -0,0 +1,113 @@
+//! Joystick teleoperation example for the Velleman/OWI Robotic Arm's C++11 interface.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#include <robotic-arm-teleoperation.h>
+#include <robotic-arm-usb.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+using namespace vijfendertig;
+
+
+//! Map a gamepad axis, centred on the range reported by the device (if it's a device).
+RoboticArmTeleoperation::AxisMapping getAxisMapping(int descriptor, uint16_t code,
+    RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action positive)
+{
+  // Defaults for the signed 16 bit axes of most gamepads (used for recordings).
+  RoboticArmTeleoperation::AxisMapping mapping{code, actuator, positive, 0, 8192, 2048};
+  struct input_absinfo absinfo;
+  if(ioctl(descriptor, EVIOCGABS(code), &absinfo) == 0 && absinfo.maximum > absinfo.minimum) {
+    mapping.centre = absinfo.minimum + (absinfo.maximum - absinfo.minimum) / 2;
+    mapping.deadband = (absinfo.maximum - absinfo.minimum) / 8;
+    mapping.hysteresis = mapping.deadband / 4;
+  }
+  return mapping;
+}
+
+
+int main(int argc, char ** argv)
+{
+  // Usage: test-teleoperation <event device or recording> [--dry-run]
+  if(argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <event device or recording> [--dry-run]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  bool dry_run = argc > 2 && std::string(argv[2]) == "--dry-run";
+  int descriptor = open(argv[1], O_RDONLY);
+  if(descriptor < 0) {
+    std::cerr << "Can't open '" << argv[1] << "'." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  RoboticArmUsb robotic_arm;
+  RoboticArmUsb::Status status;
+  if(!dry_run) {
+    std::cerr << "connect" << std::endl;
+    status = robotic_arm.connect();
+    std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
+    if(status != RoboticArmUsb::Status::kConnected) {
+      close(descriptor);
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Left stick: base and shoulder, right stick: elbow and wrist, buttons: gripper and light.
+  RoboticArmTeleoperation teleoperation{dry_run
+    ? RoboticArmTeleoperation::Submit{[](const RoboticArmTeleoperation::Commands &) {
+        return RoboticArmUsb::Status::kConnected;
+      }}
+    : RoboticArmTeleoperation::Submit{[&robotic_arm](
+          const RoboticArmTeleoperation::Commands & commands) {
+        return robotic_arm.sendCommand(commands);
+      }}};
+  teleoperation.addAxis(getAxisMapping(descriptor, ABS_X,
+        RoboticArmUsb::Actuator::kBase, RoboticArmUsb::Action::kCW));
+  teleoperation.addAxis(getAxisMapping(descriptor, ABS_Y,
+        RoboticArmUsb::Actuator::kShoulder, RoboticArmUsb::Action::kDown));
+  teleoperation.addAxis(getAxisMapping(descriptor, ABS_RY,
+        RoboticArmUsb::Actuator::kElbow, RoboticArmUsb::Action::kDown));
+  teleoperation.addAxis(getAxisMapping(descriptor, ABS_RX,
+        RoboticArmUsb::Actuator::kWrist, RoboticArmUsb::Action::kUp));
+  teleoperation.addButton(RoboticArmTeleoperation::ButtonMapping{BTN_SOUTH,
+      RoboticArmUsb::Actuator::kGripper, RoboticArmUsb::Action::kClose});
+  teleoperation.addButton(RoboticArmTeleoperation::ButtonMapping{BTN_EAST,
+      RoboticArmUsb::Actuator::kGripper, RoboticArmUsb::Action::kOpen});
+  teleoperation.addButton(RoboticArmTeleoperation::ButtonMapping{BTN_NORTH,
+      RoboticArmUsb::Actuator::kLight, RoboticArmUsb::Action::kOn});
+
+  std::cerr << "teleoperate (" << argv[1] << (dry_run ? ", dry run" : "") << ")" << std::endl;
+  status = teleoperation.run(descriptor);
+  close(descriptor);
+  bool success = status == RoboticArmUsb::Status::kConnected;
+  auto statistics = teleoperation.getStatistics();
+  std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "', "
+    << statistics.events << " events, " << statistics.reports << " reports, "
+    << statistics.submissions << " submissions, suppression ratio "
+    << RoboticArmTeleoperation::getSuppressionRatio(statistics) << ", mean latency "
+    << (statistics.submissions > 0 ? std::chrono::duration_cast<std::chrono::microseconds>(
+          statistics.total_latency).count() / int64_t(statistics.submissions) : 0)
+    << " us, worst latency "
+    << std::chrono::duration_cast<std::chrono::microseconds>(statistics.max_latency).count()
+    << " us" << std::endl;
+
+  if(!dry_run) {
+    std::cerr << "disconnect" << std::endl;
+    status = robotic_arm.disconnect();
+    std::cerr << "            ==> '" << robotic_arm.getStatusString(status) << "'" << std::endl;
+    success = success && status == RoboticArmUsb::Status::kDisconnected;
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
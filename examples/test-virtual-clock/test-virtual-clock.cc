@@ -0,0 +1,94 @@
+//! Virtual clock test program for the Velleman/OWI Robotic Arm's C++11 interface.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#include <robotic-arm-clock.h>
+#include <robotic-arm-odometer.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+
+using namespace vijfendertig;
+
+
+//! Wait (in real time) until a file exists.
+bool waitForFile(const std::string & path, std::chrono::milliseconds timeout)
+{
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(access(path.c_str(), F_OK) != 0) {
+    if(std::chrono::steady_clock::now() >= deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+
+int main(int argc, char ** argv)
+{
+  // Usage: test-virtual-clock [odometer file]
+  std::string path{argc > 1 ? argv[1] : "test-virtual-clock.odometer"};
+  auto start = std::chrono::steady_clock::now();
+  auto clock = std::make_shared<RoboticArmVirtualClock>();
+  bool success = true;
+
+  // sleepUntil(): a thread sleeping for a minute only wakes up when the clock reaches its deadline.
+  std::cerr << "sleepFor    (one minute)" << std::endl;
+  std::atomic<bool> woken{false};
+  std::thread sleeper{[&clock, &woken]() {
+    clock->sleepFor(std::chrono::minutes(1));
+    woken = true;
+  }};
+  clock->waitForWaiters(1);
+  clock->advance(std::chrono::seconds(59));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  bool early = woken;
+  clock->advance(std::chrono::seconds(1));
+  sleeper.join();
+  std::cerr << "            ==> " << (early ? "woken too early" : "woken at the deadline")
+    << std::endl;
+  success = success && !early;
+
+  // waitUntil(): the odometer's persistence thread saves every hour of virtual time.
+  std::cerr << "startPersistence (every hour, for a day)" << std::endl;
+  std::remove(path.c_str());
+  unsigned saves{0};
+  { // Odometer scope.
+    RoboticArmOdometer odometer{clock};
+    odometer.startPersistence(path, std::chrono::hours(1));
+    clock->waitForWaiters(1);
+    for(int hour = 0; hour < 24; ++ hour) {
+      std::remove(path.c_str());
+      clock->advance(std::chrono::hours(1));
+      if(waitForFile(path, std::chrono::milliseconds(1000))) {
+        ++ saves;
+      }
+    }
+    std::remove(path.c_str());
+    odometer.stopPersistence();
+    // The persistence thread saves once more when it's stopped.
+    success = success && access(path.c_str(), F_OK) == 0;
+  }
+  std::remove(path.c_str());
+  std::cerr << "            ==> " << saves << " of 24 saves" << std::endl;
+  success = success && saves == 24;
+
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - start);
+  std::cerr << "a day and a minute of virtual time in " << elapsed.count() << " ms" << std::endl;
+  std::cerr << (success ? "passed" : "failed") << std::endl;
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,125 @@
+//! Declaration of the injectable clocks for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_CLOCK__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_CLOCK__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <chrono>
+  #include <condition_variable>
+  #include <cstddef>
+  #include <memory>
+  #include <mutex>
+  #include <utility>
+  #include <vector>
+
+
+  namespace vijfendertig {
+
+    //! Clock used for all timed behaviour of the robotic arm library.
+    /*!
+     *  The robotic arm controller, its control thread and the timed features built on top of it
+     *  (like motion playback) take the time from a clock object instead of the wall clock, so
+     *  tests can replace it with a RoboticArmVirtualClock and run a minute of motion in a few
+     *  milliseconds. Performance measurements (tracing, latencies) always use the steady clock.
+     */
+    class RoboticArmClock {
+
+      public:
+
+        //! Time point type (compatible with std::chrono::steady_clock).
+        using TimePoint = std::chrono::steady_clock::time_point;
+        //! Duration type.
+        using Duration = std::chrono::steady_clock::duration;
+
+        virtual ~RoboticArmClock() = default;
+
+        //! Get the current time.
+        virtual TimePoint now() const = 0;
+        //! Block the calling thread until the given time.
+        virtual void sleepUntil(TimePoint deadline) = 0;
+        //! Wait for a notification on a condition variable or until the given time.
+        /*!
+         *  Like std::condition_variable::wait_until(), this function may return spuriously, so
+         *  the caller has to check its condition in a loop. TimePoint::max() waits for a
+         *  notification without deadline.
+         *
+         *  \param condition Condition variable to wait on.
+         *  \param lock Lock on the condition variable's mutex, held by the calling thread.
+         *  \param deadline Time to stop waiting at.
+         */
+        virtual void waitUntil(std::condition_variable & condition,
+            std::unique_lock<std::mutex> & lock, TimePoint deadline) = 0;
+
+        void sleepFor(Duration duration);
+
+        static std::shared_ptr<RoboticArmClock> getSystemClock();
+    };
+
+    //! Clock following std::chrono::steady_clock.
+    class RoboticArmSystemClock: public RoboticArmClock {
+
+      public:
+
+        TimePoint now() const override;
+        void sleepUntil(TimePoint deadline) override;
+        void waitUntil(std::condition_variable & condition,
+            std::unique_lock<std::mutex> & lock, TimePoint deadline) override;
+    };
+
+    //! Deterministic clock which only advances when told to.
+    /*!
+     *  Threads sleeping on or waiting with this clock are woken up by advance() and advanceTo()
+     *  as soon as their deadline is reached, so timed behaviour runs as fast as the test can
+     *  advance the clock, with exact and repeatable timings.
+     */
+    class RoboticArmVirtualClock: public RoboticArmClock {
+
+      public:
+
+        explicit RoboticArmVirtualClock(TimePoint start = TimePoint{});
+        RoboticArmVirtualClock(const RoboticArmVirtualClock &) = delete;
+
+        TimePoint now() const override;
+        void sleepUntil(TimePoint deadline) override;
+        void waitUntil(std::condition_variable & condition,
+            std::unique_lock<std::mutex> & lock, TimePoint deadline) override;
+
+        void advance(Duration duration);
+        void advanceTo(TimePoint time);
+        std::size_t getWaiterCount() const;
+        void waitForWaiters(std::size_t count) const;
+
+      private:
+
+        //! Mutex to protect the current time and the waiter list.
+        mutable std::mutex mutex_;
+        //! Condition variable to signal time advances to sleeping threads.
+        std::condition_variable advanced_;
+        //! Condition variable to signal changes of the waiter count.
+        mutable std::condition_variable waiters_changed_;
+        //! Current time.
+        TimePoint now_;
+        //! Threads sleeping on this clock.
+        std::size_t sleepers_;
+        //! Condition variables (and their mutexes) threads are waiting on with this clock.
+        std::vector<std::pair<std::condition_variable *, std::mutex *>> waiters_;
+
+        void advanceTo(TimePoint time, std::unique_lock<std::mutex> & lock);
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_CLOCK__
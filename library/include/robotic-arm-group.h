@@ -0,0 +1,85 @@
+//! Declaration of the synchronised group interface for multiple Velleman/OWI Robotic Arms.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_GROUP__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_GROUP__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <chrono>
+  #include <map>
+  #include <mutex>
+  #include <vector>
+
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Group of robotic arms which start and stop together.
+    /*!
+     *  A group command applies the same command state change to all arms in the group at once:
+     *  either all arms get it or (if an arm is not connected) none of them. The control threads
+     *  of all arms meet at a rendezvous before starting their USB transfers, so the transfers are
+     *  submitted as close together as the USB stack allows. The measured skew between the arms is
+     *  available after every group command.
+     *
+     *  If an arm's USB transfer doesn't complete in time (1 s), the group command fails with
+     *  kIoError. The arms which already applied the command are stopped right away and the late
+     *  arm stops as soon as its transfer finishes, so a failed group command leaves all unleased
+     *  actuators stopped rather than some arms moving on their own.
+     */
+    class RoboticArmGroup {
+
+      public:
+
+        //! Measured inter-arm skew of a group command.
+        struct Skew {
+          //! Time between the first and the last arm starting its USB transfer.
+          std::chrono::nanoseconds submission;
+          //! Time between the first and the last arm completing its USB transfer.
+          std::chrono::nanoseconds completion;
+        };
+
+        RoboticArmGroup();
+        explicit RoboticArmGroup(const std::vector<RoboticArmUsb *> & robotic_arms);
+        RoboticArmGroup(const RoboticArmGroup &) = delete;
+
+        void add(RoboticArmUsb & robotic_arm);
+
+        RoboticArmUsb::Status sendCommand(
+            RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action action);
+        RoboticArmUsb::Status sendCommand(
+            const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands);
+        RoboticArmUsb::Status sendStop();
+
+        Skew getLastSkew() const;
+
+      private:
+
+        //! Mutex to serialise group commands.
+        mutable std::mutex serialise_mutex_;
+        //! Robotic arms in the group, sorted by address (which is the order to lock them in).
+        std::vector<RoboticArmUsb *> robotic_arms_;
+        //! Skew of the last group command.
+        Skew last_skew_;
+
+        RoboticArmUsb::Status sendGroupCommand(
+            const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands,
+            bool stop);
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_GROUP__
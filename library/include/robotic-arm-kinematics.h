@@ -0,0 +1,135 @@
+//! Declaration of the kinematics solver for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_KINEMATICS__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_KINEMATICS__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <cstddef>
+  #include <cstdint>
+  #include <vector>
+
+  #include <robotic-arm-motion.h>
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Forward and inverse kinematics of the Velleman/OWI robotic arm.
+    /*!
+     *  The arm is modelled as a rotating base carrying a planar chain of three links: the upper
+     *  arm (shoulder to elbow), the forearm (elbow to wrist) and the gripper (wrist to the
+     *  gripper's tip). All angles are in radians. The base angle is measured from the x axis
+     *  towards the y axis, the shoulder angle from the horizontal plane, the elbow angle relative
+     *  to the upper arm and the wrist angle relative to the forearm. The gripper's pitch is the
+     *  sum of the shoulder, elbow and wrist angles. Lengths can be in any unit, as long as they're
+     *  consistent.
+     *
+     *  Every function has a batch variant which works on structure-of-arrays data in branch-free
+     *  loops, so the compiler can vectorise the evaluation of thousands of candidate
+     *  configurations (with GCC on x86-64, using glibc's vector math library).
+     */
+    class RoboticArmKinematics {
+
+      public:
+
+        //! Link lengths.
+        struct Links {
+          double base_height; //!< Height of the shoulder joint above the base plane.
+          double upper_arm;   //!< Distance from the shoulder joint to the elbow joint.
+          double forearm;     //!< Distance from the elbow joint to the wrist joint.
+          double gripper;     //!< Distance from the wrist joint to the gripper's tip.
+        };
+
+        //! Drive characteristics of a single joint's motor (there's no position feedback).
+        struct Drive {
+          double speed;                   //!< Angular speed in radians per second.
+          RoboticArmUsb::Action positive; //!< Action which increases the joint's angle.
+        };
+
+        //! Drive characteristics of all joints.
+        struct Drives {
+          Drive base;     //!< Base (M5).
+          Drive shoulder; //!< Shoulder (M4).
+          Drive elbow;    //!< Elbow (M3).
+          Drive wrist;    //!< Wrist (M2).
+        };
+
+        //! Joint angles.
+        struct Joints {
+          double base;     //!< Base angle.
+          double shoulder; //!< Shoulder angle.
+          double elbow;    //!< Elbow angle.
+          double wrist;    //!< Wrist angle.
+        };
+
+        //! Position and pitch of the gripper's tip.
+        struct Pose {
+          double x;     //!< X coordinate.
+          double y;     //!< Y coordinate.
+          double z;     //!< Z coordinate (height above the base plane).
+          double pitch; //!< Pitch (angle between the gripper and the horizontal plane).
+        };
+
+        //! Joint angles of multiple configurations (structure of arrays).
+        struct JointsBatch {
+          std::vector<double> base;     //!< Base angles.
+          std::vector<double> shoulder; //!< Shoulder angles.
+          std::vector<double> elbow;    //!< Elbow angles.
+          std::vector<double> wrist;    //!< Wrist angles.
+
+          void resize(std::size_t size);
+          std::size_t size() const { return base.size(); }
+        };
+
+        //! Poses of multiple configurations (structure of arrays).
+        struct PoseBatch {
+          std::vector<double> x;     //!< X coordinates.
+          std::vector<double> y;     //!< Y coordinates.
+          std::vector<double> z;     //!< Z coordinates.
+          std::vector<double> pitch; //!< Pitches.
+
+          void resize(std::size_t size);
+          std::size_t size() const { return x.size(); }
+        };
+
+        //! Reachability of multiple poses: 1.0 if reachable, 0.0 if not (a mask as wide as the
+        //! coordinates, so the batch loop can vectorise it along with the angles).
+        using ReachabilityBatch = std::vector<double>;
+
+        RoboticArmKinematics(const Links & links, const Drives & drives);
+
+        Pose forward(const Joints & joints) const;
+        void forward(const JointsBatch & joints, PoseBatch & poses) const;
+        bool inverse(const Pose & pose, Joints & joints) const;
+        void inverse(
+            const PoseBatch & poses, JointsBatch & joints, ReachabilityBatch & reachable) const;
+
+        RoboticArmMotion::Sequence getMotion(const Joints & from, const Joints & to) const;
+
+      private:
+
+        //! Link lengths.
+        Links links_;
+        //! Drive characteristics.
+        Drives drives_;
+
+        static void addStep(RoboticArmMotion::Sequence & sequence, RoboticArmUsb::Actuator actuator,
+            const Drive & drive, double from, double to);
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_KINEMATICS__
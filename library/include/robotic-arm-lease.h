@@ -0,0 +1,77 @@
+//! Declaration of the actuator leases for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_LEASE__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_LEASE__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <map>
+  #include <vector>
+
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Exclusive control of a subset of a robotic arm's actuators.
+    /*!
+     *  Independent clients (a motion planner and a tool controller for example) can each lease
+     *  the actuators they drive. Leases never overlap: acquiring a lease fails if one of its
+     *  actuators is leased already. Commands through a lease only change the lease's actuators
+     *  and are rejected (kLeaseConflict) if they touch any other actuator, while the regular
+     *  RoboticArmUsb commands are rejected if they touch a leased actuator.
+     *
+     *  Leased actuators have their own packed command word in the robotic arm controller, so
+     *  lease checks, lease changes and leased commands are lock-free bit operations: clients
+     *  driving different actuators don't wait on each other nor on the regular commands' mutexes.
+     *  The control thread merges both command words before every USB transfer.
+     *
+     *  A new lease starts with all its actuators stopped. Releasing (or destroying) a lease stops
+     *  its actuators. The emergency stop stops leased actuators too.
+     */
+    class RoboticArmLease {
+
+      public:
+
+        RoboticArmLease();
+        RoboticArmLease(RoboticArmUsb & robotic_arm,
+            const std::vector<RoboticArmUsb::Actuator> & actuators);
+        RoboticArmLease(const RoboticArmLease &) = delete;
+        RoboticArmLease(RoboticArmLease && other) noexcept;
+        ~RoboticArmLease();
+
+        RoboticArmLease & operator=(const RoboticArmLease &) = delete;
+        RoboticArmLease & operator=(RoboticArmLease && other) noexcept;
+
+        bool isAcquired() const;
+        void release();
+
+        RoboticArmUsb::Status sendCommand(
+            RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action action);
+        RoboticArmUsb::Status sendCommand(
+            const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands);
+        RoboticArmUsb::Status sendStop();
+
+      private:
+
+        //! Robotic arm the actuators are leased from (nullptr if the lease isn't acquired).
+        RoboticArmUsb * robotic_arm_;
+        //! Packed command bits of the leased actuators.
+        RoboticArmUsb::Command mask_;
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_LEASE__
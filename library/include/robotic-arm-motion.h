@@ -0,0 +1,80 @@
+//! Declaration of the motion sequence optimiser for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_MOTION__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_MOTION__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <chrono>
+  #include <cstddef>
+  #include <map>
+  #include <vector>
+
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Timed motion sequences for the Velleman/OWI robotic arm.
+    /*!
+     *  Motions are usually authored as a sequence of single actuator steps ("run the shoulder up
+     *  for 800 ms, then the elbow down for 500 ms, ..."). Since the USB interface drives all
+     *  actuators with a single command word, independent steps can run at the same time. The
+     *  optimise() function turns such a sequence into a schedule of command word transitions.
+     */
+    class RoboticArmMotion {
+
+      public:
+
+        //! Time type used for step durations and schedule offsets.
+        using Duration = std::chrono::milliseconds;
+
+        //! Single actuator step of a motion sequence.
+        struct Step {
+          RoboticArmUsb::Actuator actuator; //!< Actuator to drive.
+          RoboticArmUsb::Action action;     //!< Action to perform while the step is running.
+          Duration duration;                //!< Time to run the action before stopping again.
+          //! Indices of earlier steps which have to be finished before this step starts.
+          std::vector<std::size_t> dependencies;
+        };
+
+        //! Command word transition at a given offset from the start of a schedule.
+        struct Keyframe {
+          Duration time; //!< Offset from the start of the schedule.
+          //! Actuators changing state at this offset (as accepted by RoboticArmUsb::sendCommand()).
+          std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> commands;
+        };
+
+        //! Motion sequence as authored (one step after the other, unless stated otherwise).
+        using Sequence = std::vector<Step>;
+        //! Schedule of command word transitions, sorted by time.
+        using Schedule = std::vector<Keyframe>;
+
+        static Schedule serialise(const Sequence & sequence);
+        static Schedule optimise(const Sequence & sequence);
+        static Duration getMakespan(const Schedule & schedule);
+
+        static RoboticArmUsb::Status play(RoboticArmUsb & robotic_arm, const Schedule & schedule);
+
+      private:
+
+        static void validate(const Sequence & sequence);
+        static Schedule buildSchedule(
+            const Sequence & sequence, const std::vector<Duration::rep> & start);
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_MOTION__
@@ -0,0 +1,115 @@
+//! Declaration of the motor odometer for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_ODOMETER__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_ODOMETER__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <array>
+  #include <chrono>
+  #include <condition_variable>
+  #include <cstddef>
+  #include <cstdint>
+  #include <memory>
+  #include <mutex>
+  #include <string>
+  #include <thread>
+
+  #include <robotic-arm-clock.h>
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Lifetime usage accounting of the robotic arm's motors (and light).
+    /*!
+     *  Every robotic arm controller has an odometer (see RoboticArmUsb::getOdometer()), which is
+     *  updated with every command word successfully sent to the USB interface. For every actuator
+     *  it accounts the run time per direction, the number of starts and the number of reversals
+     *  (direction changes without stopping), so maintenance can be scheduled from real usage.
+     *  The times are taken from the robotic arm controller's clock.
+     *
+     *  The totals can be persisted periodically to a small text file, which is replaced
+     *  atomically (written to a temporary file, synced and renamed), so it survives crashes and
+     *  the totals survive restarts.
+     */
+    class RoboticArmOdometer {
+
+      public:
+
+        //! Number of actuators.
+        static constexpr std::size_t kActuatorCount = 6;
+
+        //! Usage counters of a single actuator.
+        struct Counters {
+          //! Run time per direction (index 0: action 1, index 1: action 2, see Action).
+          std::array<std::chrono::nanoseconds, 2> run_time;
+          uint64_t starts;    //!< Number of starts (from stopped).
+          uint64_t reversals; //!< Number of direction changes without stopping.
+        };
+
+        //! Usage counters of all actuators.
+        struct Snapshot {
+          std::array<Counters, kActuatorCount> actuators; //!< Counters (see getIndex()).
+
+          const Counters & get(RoboticArmUsb::Actuator actuator) const;
+        };
+
+        explicit RoboticArmOdometer(std::shared_ptr<RoboticArmClock> clock);
+        RoboticArmOdometer(const RoboticArmOdometer &) = delete;
+        ~RoboticArmOdometer();
+
+        Snapshot getSnapshot() const;
+        bool load(const std::string & path);
+        bool save(const std::string & path) const;
+        void startPersistence(const std::string & path, RoboticArmClock::Duration interval);
+        void stopPersistence();
+
+        static std::size_t getIndex(RoboticArmUsb::Actuator actuator);
+
+      private:
+
+        friend class RoboticArmUsb;
+
+        //! Actuators, in the order of the counters.
+        static const std::array<RoboticArmUsb::Actuator, kActuatorCount> actuators_;
+
+        //! Clock to take the time from.
+        std::shared_ptr<RoboticArmClock> clock_;
+        //! Mutex to protect the counters and the running actuators' state.
+        mutable std::mutex mutex_;
+        //! Counters, excluding the current run of running actuators.
+        Snapshot counters_;
+        //! Last command word.
+        uint32_t command_state_;
+        //! Start time of the current run of every running actuator.
+        std::array<RoboticArmClock::TimePoint, kActuatorCount> run_start_;
+
+        //! Persistence thread.
+        std::thread persistence_thread_;
+        //! Mutex for the condition variable to stop the persistence thread.
+        std::mutex persistence_mutex_;
+        //! Condition variable to stop the persistence thread.
+        std::condition_variable persistence_stop_;
+        //! Persistence thread should stop.
+        bool persistence_stop_requested_;
+
+        void update(uint32_t command_state);
+        void persistenceThread(std::string path, RoboticArmClock::Duration interval);
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_ODOMETER__
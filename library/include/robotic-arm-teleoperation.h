@@ -0,0 +1,158 @@
+//! Declaration of the joystick teleoperation for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_TELEOPERATION__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_TELEOPERATION__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <atomic>
+  #include <chrono>
+  #include <cstdint>
+  #include <functional>
+  #include <map>
+  #include <string>
+  #include <vector>
+  #include <linux/input.h>
+
+  #include <robotic-arm-usb.h>
+
+
+  namespace vijfendertig {
+
+    //! Teleoperation of the robotic arm with a joystick or gamepad (Linux evdev input events).
+    /*!
+     *  Axes and buttons are mapped to actuators. Axes have a deadband around their centre and a
+     *  hysteresis, so a noisy stick doesn't toggle an actuator on and off near the deadband's
+     *  edge. The input device's state is evaluated at every synchronisation report and only the
+     *  actuators whose action changed are submitted, so holding a stick doesn't flood the library
+     *  with identical commands.
+     *
+     *  Events can be read from an evdev device (/dev/input/event*) or from a recording of one
+     *  (its raw input_event structures, for example captured with cat), so the latency and the
+     *  suppression ratio can be measured without a physical device.
+     */
+    class RoboticArmTeleoperation {
+
+      public:
+
+        //! Composite (actuator/action) command.
+        using Commands = std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action>;
+        //! Function to submit a composite command with.
+        using Submit = std::function<RoboticArmUsb::Status(const Commands & commands)>;
+
+        //! Mapping of an absolute axis to an actuator.
+        /*!
+         *  The actuator runs in the positive direction when the axis value exceeds the centre by
+         *  more than the deadband and in the other direction when it's more than the deadband
+         *  below the centre. Once running, the actuator only stops when the axis value is back
+         *  within the deadband minus the hysteresis.
+         */
+        struct AxisMapping {
+          uint16_t code;                    //!< Axis code (ABS_*).
+          RoboticArmUsb::Actuator actuator; //!< Actuator to control.
+          RoboticArmUsb::Action positive;   //!< Action for axis values above the centre.
+          int32_t centre;                   //!< Axis value at rest.
+          int32_t deadband;                 //!< Maximum distance from the centre to stop at.
+          int32_t hysteresis;               //!< Extra distance towards the centre to stop at.
+        };
+
+        //! Mapping of a button to an actuator.
+        /*!
+         *  The actuator performs the action while the button is pressed and stops (or switches
+         *  off) when it's released.
+         */
+        struct ButtonMapping {
+          uint16_t code;                    //!< Button code (BTN_* or KEY_*).
+          RoboticArmUsb::Actuator actuator; //!< Actuator to control.
+          RoboticArmUsb::Action action;     //!< Action while pressed.
+        };
+
+        //! Teleoperation statistics.
+        struct Statistics {
+          uint64_t events;      //!< Number of input events processed.
+          uint64_t reports;     //!< Number of synchronisation reports processed.
+          uint64_t submissions; //!< Number of composite commands submitted.
+          //! Total time from a synchronisation report until its command was submitted.
+          std::chrono::nanoseconds total_latency;
+          //! Worst time from a synchronisation report until its command was submitted.
+          std::chrono::nanoseconds max_latency;
+        };
+
+        explicit RoboticArmTeleoperation(RoboticArmUsb & robotic_arm);
+        explicit RoboticArmTeleoperation(Submit submit);
+        RoboticArmTeleoperation(const RoboticArmTeleoperation &) = delete;
+
+        void addAxis(const AxisMapping & mapping);
+        void addButton(const ButtonMapping & mapping);
+
+        RoboticArmUsb::Status processEvent(const struct input_event & event);
+        RoboticArmUsb::Status run(int descriptor);
+        RoboticArmUsb::Status play(const std::string & path);
+        void stop();
+
+        Statistics getStatistics() const;
+        static double getSuppressionRatio(const Statistics & statistics);
+
+      private:
+
+        //! Poll interval to check for stop() while waiting for input events.
+        static const int poll_interval_ms_{100};
+
+        //! State of a mapped axis.
+        struct Axis {
+          AxisMapping mapping; //!< Mapping.
+          int32_t value;       //!< Last axis value.
+          int8_t direction;    //!< Current direction (-1, 0 or 1).
+        };
+
+        //! State of a mapped button.
+        struct Button {
+          ButtonMapping mapping; //!< Mapping.
+          bool pressed;          //!< Button is pressed.
+        };
+
+        //! Function to submit composite commands with.
+        Submit submit_;
+        //! Mapped axes.
+        std::vector<Axis> axes_;
+        //! Mapped buttons.
+        std::vector<Button> buttons_;
+        //! Actions of the last submitted command, for all mapped actuators.
+        Commands submitted_;
+        //! An event of the pending report changed an axis or button state.
+        bool report_pending_;
+        //! The kernel dropped events, so the pending report is ignored.
+        bool report_dropped_;
+        //! run() should return.
+        std::atomic<bool> stop_requested_;
+
+        //! Number of input events processed.
+        std::atomic<uint64_t> events_;
+        //! Number of synchronisation reports processed.
+        std::atomic<uint64_t> reports_;
+        //! Number of composite commands submitted.
+        std::atomic<uint64_t> submissions_;
+        //! Total submission latency (in ns).
+        std::atomic<int64_t> total_latency_;
+        //! Worst submission latency (in ns).
+        std::atomic<int64_t> max_latency_;
+
+        Commands getCommands() const;
+        RoboticArmUsb::Status evaluateReport();
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_TELEOPERATION__
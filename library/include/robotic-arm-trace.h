@@ -0,0 +1,114 @@
+//! Declaration of the control path tracer for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#ifndef __VIJFENDERTIG__ROBOTIC_ARM_TRACE__
+
+  #define __VIJFENDERTIG__ROBOTIC_ARM_TRACE__
+
+
+  #if __cplusplus < 201103L
+    #error "The robotic arm interface requires at least a C++11 compliant compiler."
+  #endif
+
+
+  #include <atomic>
+  #include <chrono>
+  #include <cstddef>
+  #include <cstdint>
+  #include <ostream>
+
+
+  namespace vijfendertig {
+
+    //! Opt-in timeline tracer for the robotic arm's control path.
+    /*!
+     *  When enabled, the library records spans (command submission, lock acquisition, control
+     *  thread wake-up and USB transfers) in a buffer per thread. Recording doesn't take any locks:
+     *  every thread only appends to its own buffer. Buffers grow in chunks as spans are recorded
+     *  and are handed over to a new thread (which gets a track of its own) when their thread
+     *  exits, so short-lived threads don't accumulate memory. The recorded timeline can be
+     *  exported as Chrome trace-event JSON, which can be loaded in Perfetto
+     *  (https://ui.perfetto.dev) or chrome://tracing.
+     *
+     *  When disabled (the default), a span costs a single relaxed atomic load and a predictable
+     *  branch when it starts and a predictable branch on its own (already loaded) name when it
+     *  ends, so the tracer can be left compiled into production builds.
+     */
+    class RoboticArmTrace {
+
+      public:
+
+        //! Clock used for all trace timestamps.
+        using Clock = std::chrono::steady_clock;
+
+        //! Scoped span, recorded from its construction until its destruction.
+        class Span {
+
+          public:
+
+            //! Start a span (if tracing is enabled).
+            /*!
+             *  \param name Span name. Must be a string literal (only the pointer is recorded).
+             */
+            explicit Span(const char * name):
+              name_{isEnabled() ? name : nullptr}
+            {
+              if(name_ != nullptr) {
+                begin_ = Clock::now();
+              }
+            }
+
+            Span(const Span &) = delete;
+
+            //! Finish and record the span (if it was started with tracing enabled).
+            ~Span()
+            {
+              if(name_ != nullptr) {
+                record(name_, begin_, Clock::now());
+              }
+            }
+
+          private:
+
+            //! Span name or nullptr if tracing was disabled when the span started.
+            const char * name_;
+            //! Span start time.
+            Clock::time_point begin_;
+        };
+
+        static void enable();
+        static void disable();
+        //! Check whether tracing is enabled.
+        static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+        static void record(const char * name, Clock::time_point begin, Clock::time_point end);
+        static void clear();
+        static std::uint64_t getDroppedCount();
+        static void writeChromeTrace(std::ostream & stream);
+
+      private:
+
+        //! Maximum number of spans per buffer. Spans beyond this limit are dropped.
+        static const std::size_t buffer_capacity_{65536};
+        //! Number of spans per chunk (buffers are allocated one chunk at a time).
+        static const std::size_t chunk_capacity_{1024};
+
+        struct Buffer;
+        struct Registry;
+
+        //! Tracing enabled flag.
+        static std::atomic<bool> enabled_;
+
+        static Registry & getRegistry();
+        static Buffer & getThreadBuffer();
+    };
+
+  }
+
+#endif // __VIJFENDERTIG__ROBOTIC_ARM_TRACE__
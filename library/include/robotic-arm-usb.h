@@ -17,15 +17,26 @@
   #endif
 
 
+  #include <array>
+  #include <atomic>
+  #include <chrono>
   #include <condition_variable>
+  #include <deque>
   #include <map>
+  #include <memory>
   #include <mutex>
   #include <thread>
+  #include <vector>
   #include <libusb-1.0/libusb.h>
 
+  #include <robotic-arm-clock.h>
+  #include <robotic-arm-trace.h>
+
 
   namespace vijfendertig {
 
+    class RoboticArmOdometer;
+
     //! C++11 Interface to the Velleman/OWI robotic arm's USB interface.
     /*!
      *  This kit is known as:
@@ -50,6 +61,9 @@
           kDeviceNotFound = -1,   //!< The robotic arm's USB interface was not found.
           kConnectionFailed = -2, //!< The connection to the robotic arms's USB interface failed.
           kInvalidCommand = -3,   //!< The given command is not valid.
+          kEmergencyStop = -4,    //!< The emergency stop is engaged. Commands are rejected.
+          kLeaseConflict = -5,    //!< The command touches an actuator leased by someone else.
+          kHomeLost = -6,         //!< No home is marked or the motion journal overflowed.
         };
 
         // Actuator definitions.
@@ -75,7 +89,62 @@
           kCCW = 2       //!< Move counterclockwise (base).
         };
 
+        //! Emergency stop statistics.
+        struct EmergencyStopStatistics {
+          uint64_t count;                        //!< Number of emergency stops sent.
+          std::chrono::nanoseconds last_latency; //!< Request to transfer completion, last stop.
+          std::chrono::nanoseconds max_latency;  //!< Request to transfer completion, worst stop.
+        };
+
+        //! Motor scheduler statistics of a single actuator (see setMotorBudget()).
+        /*!
+         *  The effective throughput of an actuator is running / requested, its total wait time is
+         *  requested - running.
+         */
+        struct MotorStatistics {
+          std::chrono::nanoseconds requested;    //!< Time the actuator was requested to run.
+          std::chrono::nanoseconds running;      //!< Time it actually ran while requested.
+          std::chrono::nanoseconds current_wait; //!< Time it's waiting now (0 if not waiting).
+          std::chrono::nanoseconds max_wait;     //!< Longest uninterrupted wait.
+        };
+
+        //! Number of buckets of the USB transfer latency histogram.
+        static constexpr std::size_t kLatencyBuckets = 24;
+        //! USB transfer latency histogram.
+        /*!
+         *  Bucket 0 counts latencies below 2 us, bucket i (i > 0) counts latencies from 2^i us up
+         *  to 2^(i+1) us. The last bucket also counts all longer latencies.
+         */
+        using LatencyHistogram = std::array<uint64_t, kLatencyBuckets>;
+
+        //! Control path statistics (see getStatistics()).
+        struct Statistics {
+          uint64_t commands;                 //!< Number of accepted commands.
+          uint64_t transfers;                //!< Number of USB transfers.
+          uint64_t transfer_errors;          //!< Number of failed USB transfers.
+          uint32_t command_state;            //!< Last raw command word transferred.
+          LatencyHistogram transfer_latency; //!< USB transfer latency histogram.
+        };
+
+        //! Event types (see pollEvents()).
+        enum class EventType: uint8_t {
+          kStatusChanged = 0,     //!< The connection state changed.
+          kTransferCompleted = 1, //!< A USB transfer completed (successfully or not).
+          kEmergencyStop = 2,     //!< The emergency stop was engaged.
+          kWatchdog = 3,          //!< A USB transfer took longer than the watchdog timeout.
+        };
+
+        //! Event reported through the event descriptor (see getEventDescriptor()).
+        struct Event {
+          EventType type;                             //!< Event type.
+          Status status;                              //!< New connection state or transfer result.
+          uint32_t command_state;                     //!< Raw command word (of a transfer).
+          std::chrono::steady_clock::time_point time; //!< Time of the event.
+          std::chrono::nanoseconds latency;           //!< Duration (of a transfer).
+        };
+
         RoboticArmUsb();
+        explicit RoboticArmUsb(std::shared_ptr<RoboticArmClock> clock);
         RoboticArmUsb(const RoboticArmUsb &) = delete;
         virtual ~RoboticArmUsb();
 
@@ -90,19 +159,90 @@
             const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands);
         Status sendStop();
 
+        void emergencyStop();
+        Status releaseEmergencyStop();
+        bool isEmergencyStopped() const;
+        EmergencyStopStatistics getEmergencyStopStatistics() const;
+
+        void markHome(std::size_t journal_capacity = default_journal_capacity_);
+        Status returnHome();
+
+        void setMotorBudget(unsigned budget,
+            RoboticArmClock::Duration quantum = std::chrono::milliseconds{100});
+        void setMotorWeight(Actuator actuator, unsigned weight);
+        std::map<Actuator, MotorStatistics> getMotorStatistics() const;
+        Status waitForMotors();
+
+        Statistics getStatistics() const;
+
+        int getEventDescriptor();
+        std::vector<Event> pollEvents();
+        uint64_t getDroppedEventCount() const;
+        void setWatchdogTimeout(std::chrono::nanoseconds timeout);
+        void setTransferTimeout(std::chrono::nanoseconds timeout);
+        static std::chrono::microseconds getLatencyPercentile(
+            const LatencyHistogram & histogram, double percentile);
+
         Status getStatus() const;
         static std::string getStatusString(Status status);
+        RoboticArmClock & getClock() const;
+        RoboticArmOdometer & getOdometer() const;
 
       private:
 
+        friend class RoboticArmGroup;
+        friend class RoboticArmLease;
+
         //! Default USB vendor ID.
         static const uint16_t default_vendor_id_{0x1267};
         //! Default USB product ID.
         static const uint16_t default_product_id_{0x0000};
+        //! Maximum number of queued events (older events are dropped).
+        static const std::size_t event_queue_capacity_{1024};
+        //! Default watchdog timeout for USB transfers (in ns).
+        static const int64_t default_watchdog_timeout_{50000000};
+        //! Default timeout for USB transfers (in ns), so a hung transfer can't block forever.
+        static const int64_t default_transfer_timeout_{1000000000};
+        //! Maximum time to wait for the control threads taking part in a group command (in ns).
+        static const int64_t group_timeout_{1000000000};
+        //! Default capacity of the motion journal (in command word transitions).
+        static const std::size_t default_journal_capacity_{4096};
 
         //! Raw command type.
         using Command = uint32_t;
 
+        //! Command word transition in the motion journal (see markHome()).
+        struct JournalEntry {
+          RoboticArmClock::TimePoint time; //!< Completion time of the USB transfer.
+          Command command_state;           //!< Raw command word transferred.
+        };
+
+        //! Rendezvous of the control threads taking part in a group command (see RoboticArmGroup).
+        struct GroupRendezvous {
+          explicit GroupRendezvous(std::size_t count);
+
+          //! Number of control threads taking part.
+          const std::size_t count;
+          //! Time after which nobody waits for missing control threads any longer.
+          const std::chrono::steady_clock::time_point deadline;
+          //! Number of control threads which arrived at the rendezvous.
+          std::atomic<std::size_t> arrived;
+          //! Start time of every control thread's USB transfer.
+          std::vector<std::chrono::steady_clock::time_point> submitted;
+          //! Completion time of every control thread's USB transfer.
+          std::vector<std::chrono::steady_clock::time_point> completed;
+          //! Mutex for the condition variable to signal the completion of all transfers.
+          std::mutex finished_mutex;
+          //! Condition variable to signal the completion of all transfers.
+          std::condition_variable finished;
+          //! Number of control threads which completed their transfer.
+          std::size_t finished_count;
+          //! Whether every control thread completed its transfer (protected by finished_mutex).
+          std::vector<bool> finished_arms;
+          //! Whether the group gave up waiting (set while holding finished_mutex).
+          std::atomic<bool> abandoned;
+        };
+
         //! Mutex to serialise USB commands.
         mutable std::mutex serialise_mutex_;
         //! Condition variable to signal the initialisation's completion.
@@ -112,23 +252,145 @@
         //! Condition variable to signal a pending command to the control thread.
         std::condition_variable control_pending_;
         //! Mutex for the condition variable to signal a pending command to the control thread.
-        std::mutex control_pending_mutex_;
+        mutable std::mutex control_pending_mutex_;
+        //! Mutex to serialise USB transfers (of the control thread and the emergency stop).
+        std::mutex transfer_mutex_;
+
+        //! Clock for all timed behaviour.
+        std::shared_ptr<RoboticArmClock> clock_;
+        //! Motor usage accounting.
+        std::unique_ptr<RoboticArmOdometer> odometer_;
 
         //! libusb context (to allow multiple libraries using libusb in the same application).
         libusb_context * libusb_context_;
         //! libusb device handle.
         libusb_device_handle * libusb_device_handle_;
 
+        //! USB transfers are possible (control thread running), protected by transfer_mutex_.
+        bool transfer_ready_;
         //! Current connection state.
-        Status connection_state_;
-        //! Current (raw) command state.
+        std::atomic<Status> connection_state_;
+        //! Current (raw) command state of the actuators which are not leased.
         Command command_state_;
+        //! Raw command state last sent (protected by control_pending_mutex_).
+        Command command_state_sent_;
+        //! Packed command bits of the leased actuators (see RoboticArmLease).
+        std::atomic<Command> lease_mask_;
+        //! Current (raw) command state of the leased actuators.
+        std::atomic<Command> leased_command_state_;
+        //! Control thread is waiting for pending commands (or about to).
+        std::atomic<bool> control_waiting_;
+        //! Time of the last notification to the control thread (only set while tracing).
+        RoboticArmTrace::Clock::time_point control_notified_;
+        //! Emergency stop engaged (latched until released).
+        std::atomic<bool> emergency_stop_;
+        //! Steady clock time (in ns) of the pending emergency stop request, 0 if none is pending.
+        std::atomic<int64_t> emergency_stop_requested_;
+        //! Number of emergency stops sent.
+        std::atomic<uint64_t> emergency_stop_count_;
+        //! Latency of the last emergency stop (in ns).
+        std::atomic<int64_t> emergency_stop_last_latency_;
+        //! Latency of the worst emergency stop (in ns).
+        std::atomic<int64_t> emergency_stop_max_latency_;
+        //! Number of accepted commands.
+        std::atomic<uint64_t> statistics_commands_;
+        //! Number of USB transfers.
+        std::atomic<uint64_t> statistics_transfers_;
+        //! Number of failed USB transfers.
+        std::atomic<uint64_t> statistics_transfer_errors_;
+        //! Last raw command word transferred.
+        std::atomic<Command> statistics_command_state_;
+        //! USB transfer latency histogram (see LatencyHistogram).
+        std::array<std::atomic<uint64_t>, kLatencyBuckets> statistics_transfer_latency_;
+
+        //! Mutex to protect the event queue and the event descriptor.
+        mutable std::mutex events_mutex_;
+        //! Events are queued (the event descriptor was created).
+        std::atomic<bool> events_enabled_;
+        //! Event descriptor to read from (readable while events are queued, -1 if not created).
+        int event_descriptor_;
+        //! Event descriptor to write to (the same as event_descriptor_ for an eventfd).
+        int event_write_descriptor_;
+        //! Queued events.
+        std::deque<Event> events_;
+        //! Number of events dropped because the queue was full.
+        uint64_t events_dropped_;
+        //! Watchdog timeout for USB transfers (in ns).
+        std::atomic<int64_t> watchdog_timeout_;
+        //! Timeout for USB transfers (in ns, 0 for none).
+        std::atomic<int64_t> transfer_timeout_;
+
+        //! Command word transitions since the home mark, protected by transfer_mutex_.
+        std::vector<JournalEntry> journal_;
+        //! Journal capacity (0 if no home is marked), protected by transfer_mutex_.
+        std::size_t journal_capacity_;
+        //! The journal overflowed since the home mark, protected by transfer_mutex_.
+        bool journal_overflow_;
+
+        //! Maximum total weight of the running actuators (0 if unlimited).
+        unsigned motor_budget_;
+        //! Time slice of the motor scheduler.
+        RoboticArmClock::Duration motor_quantum_;
+        //! Weight (current draw) of every actuator.
+        std::map<Actuator, unsigned> motor_weights_;
+        //! The control thread schedules the actuators (a budget is set or run time is owed).
+        bool motor_scheduling_;
+        //! Packed command bits of the actuators allowed to run in the current time slice.
+        Command motor_granted_;
+        //! Index of the actuator to consider first in the next time slice.
+        std::size_t motor_next_;
+        //! End of the current time slice (TimePoint::max() if the budget isn't exceeded).
+        RoboticArmClock::TimePoint motor_slice_end_;
+        //! Next time the control thread has to reschedule (TimePoint::max() if none).
+        RoboticArmClock::TimePoint motor_deadline_;
+        //! Time the motor statistics and backlogs were last updated.
+        RoboticArmClock::TimePoint motor_accounted_;
+        //! Requested command state since the last update.
+        Command motor_requested_;
+        //! Demanded command state (owed run time first) since the last update.
+        Command motor_demanded_;
+        //! Scheduled command state since the last update.
+        Command motor_running_;
+        //! Run time owed to every actuator, per action, oldest first.
+        std::map<Actuator, std::deque<std::pair<Action, RoboticArmClock::Duration>>>
+          motor_backlog_;
+        //! Condition variable to signal that no run time is owed to any actuator.
+        std::condition_variable motor_idle_;
+        //! Motor scheduler statistics.
+        std::map<Actuator, MotorStatistics> motor_statistics_;
+
+        //! Pending group command rendezvous (nullptr if none).
+        std::shared_ptr<GroupRendezvous> group_rendezvous_;
+        //! Index of this robotic arm in the pending group command.
+        std::size_t group_index_;
 
         //! USB control thread.
         std::thread control_thread_;
 
+        static Command updateCommandState(Command command_state,
+            const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands);
         void controlThread();
+        Command getEffectiveCommandState() const;
+        void notifyControlThread();
+        void wakeControlThread();
+        bool acquireLease(Command mask);
+        void releaseLease(Command mask);
+        Status sendLeasedCommand(Command lease, Command mask, Command command_state);
+        static Command getActuatorMask(Actuator actuator);
+        void completeEmergencyStop(int64_t requested);
+        bool finishGroupRendezvous(GroupRendezvous & group_rendezvous);
+        void abandonGroupCommand();
         Status sendCommandState(Command command_state);
+        Status transferCommandState(Command command_state);
+        void countCommand();
+        Command scheduleMotors(Command command_state);
+        void accountMotors(std::map<Actuator, MotorStatistics> & statistics,
+            RoboticArmClock::Duration elapsed) const;
+        void updateMotorBacklog(RoboticArmClock::Duration elapsed);
+        bool isMotorBacklogEmpty() const;
+        void clearMotorBacklog(Command mask = ~ Command(0));
+        void pushEvent(EventType type, Status status, Command command_state = 0,
+            std::chrono::nanoseconds latency = std::chrono::nanoseconds{0});
     };
 
   }
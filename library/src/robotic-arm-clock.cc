@@ -0,0 +1,216 @@
+//! Implementation of the injectable clocks for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-clock.h>
+
+#include <algorithm>
+#include <thread>
+
+
+namespace vijfendertig {
+
+  //! Block the calling thread for the given duration.
+  /*!
+   *  \param duration Time to sleep.
+   */
+  void RoboticArmClock::sleepFor(Duration duration)
+  {
+    sleepUntil(now() + duration);
+  }
+
+  //! Get the (shared) system clock.
+  /*!
+   *  \return Clock following std::chrono::steady_clock.
+   */
+  std::shared_ptr<RoboticArmClock> RoboticArmClock::getSystemClock()
+  {
+    static std::shared_ptr<RoboticArmClock> system_clock{
+      std::make_shared<RoboticArmSystemClock>()};
+    return system_clock;
+  }
+
+
+  //! Get the current time.
+  /*!
+   *  \return Current time of std::chrono::steady_clock.
+   */
+  RoboticArmClock::TimePoint RoboticArmSystemClock::now() const
+  {
+    return std::chrono::steady_clock::now();
+  }
+
+  //! Block the calling thread until the given time.
+  /*!
+   *  \param deadline Time to wake up at.
+   */
+  void RoboticArmSystemClock::sleepUntil(TimePoint deadline)
+  {
+    std::this_thread::sleep_until(deadline);
+  }
+
+  //! Wait for a notification on a condition variable or until the given time.
+  /*!
+   *  \param condition Condition variable to wait on.
+   *  \param lock Lock on the condition variable's mutex, held by the calling thread.
+   *  \param deadline Time to stop waiting at (TimePoint::max() to wait without deadline).
+   */
+  void RoboticArmSystemClock::waitUntil(std::condition_variable & condition,
+      std::unique_lock<std::mutex> & lock, TimePoint deadline)
+  {
+    if(deadline == TimePoint::max()) {
+      condition.wait(lock);
+    }
+    else {
+      condition.wait_until(lock, deadline);
+    }
+  }
+
+
+  //! Create a virtual clock.
+  /*!
+   *  \param start Initial time.
+   */
+  RoboticArmVirtualClock::RoboticArmVirtualClock(TimePoint start):
+    now_{start},
+    sleepers_{0}
+  {}
+
+  //! Get the current (virtual) time.
+  /*!
+   *  \return Current time.
+   */
+  RoboticArmClock::TimePoint RoboticArmVirtualClock::now() const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return now_;
+  }
+
+  //! Block the calling thread until the clock is advanced to the given time.
+  /*!
+   *  \param deadline Time to wake up at.
+   */
+  void RoboticArmVirtualClock::sleepUntil(TimePoint deadline)
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    ++ sleepers_;
+    waiters_changed_.notify_all();
+    advanced_.wait(lock, [this, deadline]{return now_ >= deadline;});
+    -- sleepers_;
+    waiters_changed_.notify_all();
+  }
+
+  //! Wait for a notification on a condition variable or until the clock reaches the given time.
+  /*!
+   *  The condition variable is registered, so advance() can wake the waiting thread. To prevent
+   *  lost wake-ups, advance() acquires the condition variable's mutex before notifying it.
+   *
+   *  \param condition Condition variable to wait on.
+   *  \param lock Lock on the condition variable's mutex, held by the calling thread.
+   *  \param deadline Time to stop waiting at (TimePoint::max() to wait without deadline).
+   */
+  void RoboticArmVirtualClock::waitUntil(std::condition_variable & condition,
+      std::unique_lock<std::mutex> & lock, TimePoint deadline)
+  {
+    if(deadline == TimePoint::max()) {
+      // Without deadline, the time doesn't matter.
+      condition.wait(lock);
+      return;
+    }
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> clock_lock{mutex_};
+      if(now_ >= deadline) {
+        return;
+      }
+      waiters_.emplace_back(&condition, lock.mutex());
+      waiters_changed_.notify_all();
+    }
+    condition.wait(lock);
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> clock_lock{mutex_};
+      waiters_.erase(std::find(waiters_.begin(), waiters_.end(),
+            std::make_pair(&condition, lock.mutex())));
+      waiters_changed_.notify_all();
+    }
+  }
+
+  //! Advance the clock and wake up all threads whose deadline is reached.
+  /*!
+   *  Don't call this function while holding a mutex other threads wait on with this clock.
+   *
+   *  \param duration Time to advance the clock with.
+   */
+  void RoboticArmVirtualClock::advance(Duration duration)
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    advanceTo(now_ + duration, lock);
+  }
+
+  //! Advance the clock to the given time and wake up all threads whose deadline is reached.
+  /*!
+   *  Don't call this function while holding a mutex other threads wait on with this clock. Times
+   *  in the past are ignored (the clock is monotonic).
+   *
+   *  \param time Time to advance the clock to.
+   */
+  void RoboticArmVirtualClock::advanceTo(TimePoint time)
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    advanceTo(time, lock);
+  }
+
+  //! Get the number of threads sleeping on or waiting with this clock.
+  /*!
+   *  Threads waiting without deadline are not counted.
+   *
+   *  \return Number of blocked threads.
+   */
+  std::size_t RoboticArmVirtualClock::getWaiterCount() const
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return sleepers_ + waiters_.size();
+  }
+
+  //! Block until at least the given number of threads are sleeping on or waiting with the clock.
+  /*!
+   *  Tests use this function to make sure the threads under test reached their timed wait before
+   *  advancing the clock.
+   *
+   *  \param count Number of blocked threads to wait for.
+   */
+  void RoboticArmVirtualClock::waitForWaiters(std::size_t count) const
+  {
+    std::unique_lock<std::mutex> lock{mutex_};
+    waiters_changed_.wait(lock, [this, count]{return sleepers_ + waiters_.size() >= count;});
+  }
+
+  //! Advance the clock to the given time (with the clock's mutex already locked).
+  /*!
+   *  \param time Time to advance the clock to.
+   *  \param lock Lock on mutex_, released before the waiting threads are notified.
+   */
+  void RoboticArmVirtualClock::advanceTo(TimePoint time, std::unique_lock<std::mutex> & lock)
+  {
+    now_ = std::max(now_, time);
+    auto waiters = waiters_;
+    lock.unlock();
+    advanced_.notify_all();
+    for(const auto & waiter: waiters) {
+      // Once we got the mutex, the waiting thread is either blocked on the condition variable or
+      // it didn't check the time yet.
+      { std::lock_guard<std::mutex> waiter_lock{*waiter.second}; }
+      waiter.first->notify_all();
+    }
+  }
+
+}
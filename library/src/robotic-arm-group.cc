@@ -0,0 +1,221 @@
+//! Implementation of the synchronised group interface for multiple Velleman/OWI Robotic Arms.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-group.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+
+namespace vijfendertig {
+
+  //! Create an empty group.
+  RoboticArmGroup::RoboticArmGroup():
+    robotic_arms_{},
+    last_skew_{std::chrono::nanoseconds{0}, std::chrono::nanoseconds{0}}
+  {}
+
+  //! Create a group of robotic arms.
+  /*!
+   *  \param robotic_arms Robotic arms to add to the group. They must outlive the group.
+   */
+  RoboticArmGroup::RoboticArmGroup(const std::vector<RoboticArmUsb *> & robotic_arms):
+    RoboticArmGroup()
+  {
+    for(auto robotic_arm: robotic_arms) {
+      add(*robotic_arm);
+    }
+  }
+
+  //! Add a robotic arm to the group.
+  /*!
+   *  Adding an arm which is already in the group is ignored.
+   *
+   *  \param robotic_arm Robotic arm to add. It must outlive the group.
+   */
+  void RoboticArmGroup::add(RoboticArmUsb & robotic_arm)
+  {
+    std::lock_guard<std::mutex> lock{serialise_mutex_};
+    auto position = std::lower_bound(robotic_arms_.begin(), robotic_arms_.end(), &robotic_arm,
+        std::less<RoboticArmUsb *>());
+    if(position == robotic_arms_.end() || *position != &robotic_arm) {
+      robotic_arms_.insert(position, &robotic_arm);
+    }
+  }
+
+  //! Send a command to all robotic arms in the group.
+  /*!
+   *  \param actuator Actuator.
+   *  \param action Action.
+   *  \return kConnected on success, kInvalidCommand if the given command was not valid, the
+   *      status of the first arm which is not connected, kEmergencyStop if an arm's emergency
+   *      stop is engaged or kLeaseConflict if an arm leased the actuator (no arm gets the command
+   *      in these cases) or kIoError on USB errors or timeouts (which stop the group).
+   */
+  RoboticArmUsb::Status RoboticArmGroup::sendCommand(
+      RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action action)
+  {
+    return sendCommand(
+        std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action>{{actuator, action}});
+  }
+
+  //! Send a composite command to all robotic arms in the group.
+  /*!
+   *  \param commands Composite (actuator/action) command.
+   *  \return kConnected on success, kInvalidCommand if at least one of the given commands was not
+   *      valid, the status of the first arm which is not connected, kEmergencyStop if an arm's
+   *      emergency stop is engaged or kLeaseConflict if an arm leased one of the actuators (no
+   *      arm gets the command in these cases) or kIoError on USB errors or timeouts (which stop
+   *      the group).
+   */
+  RoboticArmUsb::Status RoboticArmGroup::sendCommand(
+      const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands)
+  {
+    // Check whether we received a valid command before aqcuiring the mutexes.
+    if(!RoboticArmUsb::isCommandValid(commands)) {
+      return RoboticArmUsb::Status::kInvalidCommand;
+    }
+    else {
+      return sendGroupCommand(commands, false);
+    }
+  }
+
+  //! Send a stop command to all robotic arms in the group.
+  /*!
+   *  \return kConnected on success, the status of the first arm which is not connected (no arm
+   *      gets the command in that case) or kIoError on USB errors or timeouts (which stop the
+   *      group).
+   */
+  RoboticArmUsb::Status RoboticArmGroup::sendStop()
+  {
+    return sendGroupCommand({}, true);
+  }
+
+  //! Get the measured skew of the last group command.
+  /*!
+   *  \return Skew between the arms' USB transfers (zero if no group command was sent yet).
+   */
+  RoboticArmGroup::Skew RoboticArmGroup::getLastSkew() const
+  {
+    std::lock_guard<std::mutex> lock{serialise_mutex_};
+    return last_skew_;
+  }
+
+  //! Apply a command state change to all robotic arms in the group.
+  /*!
+   *  All arms' serialise mutexes are held for the whole group command (acquired in address order
+   *  to avoid deadlocks between overlapping groups), so no arm can connect, disconnect or get
+   *  other commands in between. All arms' command states are updated while holding all their
+   *  control mutexes, after which their control threads meet at a common rendezvous and start
+   *  their USB transfers together. The connection states are checked again while holding the
+   *  control mutexes, as a control thread may have failed a transfer (and stopped) in between.
+   *  The rendezvous and the wait for the transfers are bounded, so a control thread which hangs
+   *  in a USB transfer can't block the group (and the other arms) forever. If the group gives up
+   *  waiting, it stops the arms which already applied the command and the late control threads
+   *  stop their arm when they finish, rather than leaving the group half moving.
+   *
+   *  \param commands Composite (actuator/action) command (must be valid).
+   *  \param stop Stop all actuators instead of applying the composite command.
+   *  \return kConnected on success, the status of the first arm which is not connected,
+   *      kEmergencyStop if an arm's emergency stop is engaged, kLeaseConflict if an arm leased
+   *      one of the actuators or kIoError on USB errors or if an arm's transfer didn't complete in
+   *      time (all unleased actuators of all arms are stopped in that case).
+   */
+  RoboticArmUsb::Status RoboticArmGroup::sendGroupCommand(
+      const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands, bool stop)
+  {
+    std::lock_guard<std::mutex> lock{serialise_mutex_};
+    std::vector<std::unique_lock<std::mutex>> serialise_locks;
+    for(auto robotic_arm: robotic_arms_) {
+      serialise_locks.emplace_back(robotic_arm->serialise_mutex_);
+    }
+    RoboticArmUsb::Command mask{0};
+    for(const auto & command: commands) {
+      mask |= RoboticArmUsb::getActuatorMask(command.first);
+    }
+    for(auto robotic_arm: robotic_arms_) {
+      if(robotic_arm->connection_state_ != RoboticArmUsb::Status::kConnected) {
+        return robotic_arm->connection_state_;
+      }
+      if(!stop && robotic_arm->emergency_stop_) {
+        return RoboticArmUsb::Status::kEmergencyStop;
+      }
+      if(!stop && (robotic_arm->lease_mask_ & mask) != 0) {
+        return RoboticArmUsb::Status::kLeaseConflict;
+      }
+    }
+    auto rendezvous = std::make_shared<RoboticArmUsb::GroupRendezvous>(robotic_arms_.size());
+    { // Control locks scope.
+      std::vector<std::unique_lock<std::mutex>> control_locks;
+      for(auto robotic_arm: robotic_arms_) {
+        control_locks.emplace_back(robotic_arm->control_pending_mutex_);
+      }
+      // While the control mutexes are held, every control thread is waiting (or stopped).
+      for(auto robotic_arm: robotic_arms_) {
+        if(robotic_arm->connection_state_ != RoboticArmUsb::Status::kConnected) {
+          return robotic_arm->connection_state_;
+        }
+      }
+      for(std::size_t index = 0; index < robotic_arms_.size(); ++ index) {
+        RoboticArmUsb & robotic_arm = *robotic_arms_[index];
+        robotic_arm.command_state_ = stop
+          ? 0 : RoboticArmUsb::updateCommandState(robotic_arm.command_state_, commands);
+        robotic_arm.group_rendezvous_ = rendezvous;
+        robotic_arm.group_index_ = index;
+        robotic_arm.countCommand();
+        robotic_arm.notifyControlThread();
+      }
+    }
+    std::vector<bool> finished_arms;
+    { // unique_lock scope.
+      std::unique_lock<std::mutex> finished_lock{rendezvous->finished_mutex};
+      if(!rendezvous->finished.wait_until(finished_lock, rendezvous->deadline,
+            [&rendezvous]{return rendezvous->finished_count == rendezvous->count;})) {
+        // The rendezvous is shared, so the late control threads can still finish it. They stop
+        // their arm themselves once they see it's abandoned.
+        rendezvous->abandoned = true;
+        finished_arms = rendezvous->finished_arms;
+      }
+    }
+    if(!finished_arms.empty()) {
+      // Stop the arms which already applied the command, so no arm keeps running on its own.
+      for(std::size_t index = 0; index < robotic_arms_.size(); ++ index) {
+        if(finished_arms[index]) {
+          RoboticArmUsb & robotic_arm = *robotic_arms_[index];
+          std::lock_guard<std::mutex> control_lock{robotic_arm.control_pending_mutex_};
+          robotic_arm.abandonGroupCommand();
+          robotic_arm.notifyControlThread();
+        }
+      }
+      return RoboticArmUsb::Status::kIoError;
+    }
+    if(!robotic_arms_.empty()) {
+      auto submitted = std::minmax_element(
+          rendezvous->submitted.begin(), rendezvous->submitted.end());
+      auto completed = std::minmax_element(
+          rendezvous->completed.begin(), rendezvous->completed.end());
+      last_skew_ = Skew{*submitted.second - *submitted.first, *completed.second - *completed.first};
+    }
+    auto status = RoboticArmUsb::Status::kConnected;
+    for(auto robotic_arm: robotic_arms_) {
+      std::lock_guard<std::mutex> control_lock{robotic_arm->control_pending_mutex_};
+      if(status == RoboticArmUsb::Status::kConnected) {
+        status = robotic_arm->connection_state_;
+      }
+    }
+    return status;
+  }
+
+}
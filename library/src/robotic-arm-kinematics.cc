@@ -0,0 +1,300 @@
+//! Implementation of the kinematics solver for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-kinematics.h>
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+// glibc only declares its vector math functions (libmvec, x86-64 only, acos() and atan2() since
+// glibc 2.35) for -ffast-math, which would also fold the NaN checks. Declare the ones used by the
+// batch loops like glibc does, so GCC can vectorise them with -fno-math-errno (see CMakeLists.txt).
+#if defined(__x86_64__) && defined(__GNUC__) && __GNUC__ >= 6 && !defined(__clang__) \
+    && defined(__GLIBC__) && !defined(__FAST_MATH__)
+  #if __GLIBC_PREREQ(2, 35)
+    #define VIJFENDERTIG_KINEMATICS_VECTOR_MATH
+    extern "C" {
+      double cos(double) __THROW __attribute__((__simd__("notinbranch")));
+      double acos(double) __THROW __attribute__((__simd__("notinbranch")));
+      double atan2(double, double) __THROW __attribute__((__simd__("notinbranch")));
+    }
+  #endif
+#endif
+
+
+namespace vijfendertig {
+
+  namespace {
+
+    //! Sine for the batch loops.
+    /*!
+     *  Calculating the sine and cosine of the same angle makes GCC merge both into a single
+     *  sincos() call, which has no vector variant and prevents the loop from being vectorised.
+     *  With vector math, the sine is calculated as a cosine to avoid that. Without it, the loops
+     *  aren't vectorised and the merged sincos() call is faster.
+     *
+     *  \param angle Angle in radians.
+     *  \return Sine of the angle.
+     */
+    inline double batchSin(double angle)
+    {
+#ifdef VIJFENDERTIG_KINEMATICS_VECTOR_MATH
+      return std::cos(1.57079632679489661923 - angle);
+#else
+      return std::sin(angle);
+#endif
+    }
+
+    //! Forward kinematics loop for RoboticArmKinematics::forward().
+    /*!
+     *  The loop has no branches and its arrays are passed as non-aliasing (restrict) parameters,
+     *  so the compiler can vectorise it without runtime alias checks.
+     */
+    void forwardBatch(const RoboticArmKinematics::Links & links, std::size_t size,
+        const double * __restrict base, const double * __restrict shoulder,
+        const double * __restrict elbow, const double * __restrict wrist,
+        double * __restrict x, double * __restrict y, double * __restrict z,
+        double * __restrict pitch)
+    {
+      const double base_height{links.base_height};
+      const double upper_arm{links.upper_arm};
+      const double forearm{links.forearm};
+      const double gripper{links.gripper};
+      for(std::size_t index = 0; index < size; ++ index) {
+        double elbow_pitch = shoulder[index] + elbow[index];
+        double gripper_pitch = elbow_pitch + wrist[index];
+        double reach = upper_arm * std::cos(shoulder[index]) + forearm * std::cos(elbow_pitch)
+          + gripper * std::cos(gripper_pitch);
+        z[index] = base_height + upper_arm * batchSin(shoulder[index])
+          + forearm * batchSin(elbow_pitch) + gripper * batchSin(gripper_pitch);
+        x[index] = reach * std::cos(base[index]);
+        y[index] = reach * batchSin(base[index]);
+        pitch[index] = gripper_pitch;
+      }
+    }
+
+    //! Inverse kinematics loop for RoboticArmKinematics::inverse().
+    /*!
+     *  The loop has no branches and its arrays are passed as non-aliasing (restrict) parameters,
+     *  so the compiler can vectorise it without runtime alias checks. Unreachable poses are
+     *  clamped to the nearest elbow angle and flagged in a mask as wide as the angles (narrower
+     *  flags keep GCC from vectorising the loop without AVX2).
+     */
+    void inverseBatch(const RoboticArmKinematics::Links & links, std::size_t size,
+        const double * __restrict x, const double * __restrict y,
+        const double * __restrict z, const double * __restrict pitch,
+        double * __restrict base, double * __restrict shoulder, double * __restrict elbow,
+        double * __restrict wrist, double * __restrict reachable)
+    {
+      const double base_height{links.base_height};
+      const double upper_arm{links.upper_arm};
+      const double forearm{links.forearm};
+      const double gripper{links.gripper};
+      const double scale{1.0 / (2.0 * upper_arm * forearm)};
+      const double offset{upper_arm * upper_arm + forearm * forearm};
+      for(std::size_t index = 0; index < size; ++ index) {
+        double reach = std::sqrt(x[index] * x[index] + y[index] * y[index])
+          - gripper * std::cos(pitch[index]);
+        double height = z[index] - base_height - gripper * batchSin(pitch[index]);
+        double cos_elbow = (reach * reach + height * height - offset) * scale;
+        // Written like this, GCC compiles it to a vector compare and mask (NaN is unreachable).
+        reachable[index] = std::fabs(cos_elbow) <= 1.0 ? 1.0 : 0.0;
+        double elbow_angle = - std::acos(std::min(1.0, std::max(-1.0, cos_elbow)));
+        double shoulder_angle = std::atan2(height, reach) - std::atan2(
+            forearm * batchSin(elbow_angle), upper_arm + forearm * std::cos(elbow_angle));
+        base[index] = std::atan2(y[index], x[index]);
+        shoulder[index] = shoulder_angle;
+        elbow[index] = elbow_angle;
+        wrist[index] = pitch[index] - shoulder_angle - elbow_angle;
+      }
+    }
+
+  }
+
+  //! Resize all arrays of a joints batch.
+  /*!
+   *  \param size New number of configurations.
+   */
+  void RoboticArmKinematics::JointsBatch::resize(std::size_t size)
+  {
+    base.resize(size);
+    shoulder.resize(size);
+    elbow.resize(size);
+    wrist.resize(size);
+  }
+
+  //! Resize all arrays of a pose batch.
+  /*!
+   *  \param size New number of configurations.
+   */
+  void RoboticArmKinematics::PoseBatch::resize(std::size_t size)
+  {
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+    pitch.resize(size);
+  }
+
+  //! Create a kinematics solver.
+  /*!
+   *  \param links Link lengths.
+   *  \param drives Drive characteristics, used to translate joint motions into actuator steps.
+   *  \throws std::invalid_argument if a link length is negative, a speed is not positive or a
+   *      positive direction is not a motor direction (kUp/kDown or kCW/kCCW, not kStop).
+   */
+  RoboticArmKinematics::RoboticArmKinematics(const Links & links, const Drives & drives):
+    links_(links),
+    drives_(drives)
+  {
+    if(links_.base_height < 0.0 || links_.upper_arm <= 0.0 || links_.forearm <= 0.0
+        || links_.gripper < 0.0) {
+      throw std::invalid_argument("Invalid link lengths for the robotic arm's kinematics");
+    }
+    if(!(drives_.base.speed > 0.0 && drives_.shoulder.speed > 0.0 && drives_.elbow.speed > 0.0
+          && drives_.wrist.speed > 0.0)) {
+      throw std::invalid_argument("Invalid drive speeds for the robotic arm's kinematics");
+    }
+    // Every motor has two directions (value 1 and 2, see addStep()).
+    auto isDirection = [](const Drive & drive) {
+        return drive.positive == RoboticArmUsb::Action(1)
+          || drive.positive == RoboticArmUsb::Action(2);
+      };
+    if(!(isDirection(drives_.base) && isDirection(drives_.shoulder)
+          && isDirection(drives_.elbow) && isDirection(drives_.wrist))) {
+      throw std::invalid_argument("Invalid drive directions for the robotic arm's kinematics");
+    }
+  }
+
+  //! Calculate the gripper's pose for the given joint angles.
+  /*!
+   *  \param joints Joint angles.
+   *  \return Pose of the gripper's tip.
+   */
+  RoboticArmKinematics::Pose RoboticArmKinematics::forward(const Joints & joints) const
+  {
+    double elbow_pitch = joints.shoulder + joints.elbow;
+    double pitch = elbow_pitch + joints.wrist;
+    double reach = links_.upper_arm * std::cos(joints.shoulder)
+      + links_.forearm * std::cos(elbow_pitch) + links_.gripper * std::cos(pitch);
+    double height = links_.base_height + links_.upper_arm * std::sin(joints.shoulder)
+      + links_.forearm * std::sin(elbow_pitch) + links_.gripper * std::sin(pitch);
+    return Pose{reach * std::cos(joints.base), reach * std::sin(joints.base), height, pitch};
+  }
+
+  //! Calculate the gripper's poses for a batch of joint angles.
+  /*!
+   *  \param joints Joint angles of all configurations.
+   *  \param poses Poses of the gripper's tip (resized to the number of configurations).
+   */
+  void RoboticArmKinematics::forward(const JointsBatch & joints, PoseBatch & poses) const
+  {
+    poses.resize(joints.size());
+    forwardBatch(links_, joints.size(),
+        joints.base.data(), joints.shoulder.data(), joints.elbow.data(), joints.wrist.data(),
+        poses.x.data(), poses.y.data(), poses.z.data(), poses.pitch.data());
+  }
+
+  //! Calculate the joint angles for the given gripper pose.
+  /*!
+   *  Of the two possible elbow configurations, the elbow-up configuration is returned.
+   *
+   *  \param pose Pose of the gripper's tip.
+   *  \param joints Joint angles (only valid if the pose is reachable).
+   *  \return True if the pose is reachable, false if not.
+   */
+  bool RoboticArmKinematics::inverse(const Pose & pose, Joints & joints) const
+  {
+    double reach = std::hypot(pose.x, pose.y) - links_.gripper * std::cos(pose.pitch);
+    double height = pose.z - links_.base_height - links_.gripper * std::sin(pose.pitch);
+    double cos_elbow = (reach * reach + height * height - links_.upper_arm * links_.upper_arm
+        - links_.forearm * links_.forearm) / (2.0 * links_.upper_arm * links_.forearm);
+    if(!(cos_elbow >= -1.0 && cos_elbow <= 1.0)) {
+      return false;
+    }
+    double elbow = - std::acos(cos_elbow);
+    double shoulder = std::atan2(height, reach) - std::atan2(
+        links_.forearm * std::sin(elbow), links_.upper_arm + links_.forearm * std::cos(elbow));
+    joints = Joints{std::atan2(pose.y, pose.x), shoulder, elbow, pose.pitch - shoulder - elbow};
+    return true;
+  }
+
+  //! Calculate the joint angles for a batch of gripper poses.
+  /*!
+   *  Of the two possible elbow configurations, the elbow-up configuration is returned.
+   *
+   *  \param poses Poses of the gripper's tip.
+   *  \param joints Joint angles of all configurations (resized to the number of configurations,
+   *      only valid for reachable poses).
+   *  \param reachable Reachability of every pose (resized to the number of configurations).
+   */
+  void RoboticArmKinematics::inverse(
+      const PoseBatch & poses, JointsBatch & joints, ReachabilityBatch & reachable) const
+  {
+    joints.resize(poses.size());
+    reachable.resize(poses.size());
+    inverseBatch(links_, poses.size(),
+        poses.x.data(), poses.y.data(), poses.z.data(), poses.pitch.data(),
+        joints.base.data(), joints.shoulder.data(), joints.elbow.data(), joints.wrist.data(),
+        reachable.data());
+  }
+
+  //! Translate a joint motion into actuator steps.
+  /*!
+   *  Every joint gets a step which runs its motor long enough (at the configured speed) to cover
+   *  the angle difference. The steps don't depend on each other, so RoboticArmMotion::optimise()
+   *  runs all of them at the same time. Without position feedback, the accuracy is limited by
+   *  the accuracy of the configured speeds.
+   *
+   *  \param from Current joint angles.
+   *  \param to Target joint angles (use inverse() to get them for a target pose).
+   *  \return Motion sequence (without steps for joints which don't need to move).
+   */
+  RoboticArmMotion::Sequence RoboticArmKinematics::getMotion(
+      const Joints & from, const Joints & to) const
+  {
+    RoboticArmMotion::Sequence sequence;
+    addStep(sequence, RoboticArmUsb::Actuator::kBase, drives_.base, from.base, to.base);
+    addStep(sequence, RoboticArmUsb::Actuator::kShoulder, drives_.shoulder,
+        from.shoulder, to.shoulder);
+    addStep(sequence, RoboticArmUsb::Actuator::kElbow, drives_.elbow, from.elbow, to.elbow);
+    addStep(sequence, RoboticArmUsb::Actuator::kWrist, drives_.wrist, from.wrist, to.wrist);
+    return sequence;
+  }
+
+  //! Add a step for a single joint to a motion sequence.
+  /*!
+   *  \param sequence Motion sequence to add the step to.
+   *  \param actuator Joint's actuator.
+   *  \param drive Joint's drive characteristics.
+   *  \param from Current joint angle.
+   *  \param to Target joint angle.
+   */
+  void RoboticArmKinematics::addStep(RoboticArmMotion::Sequence & sequence,
+      RoboticArmUsb::Actuator actuator, const Drive & drive, double from, double to)
+  {
+    std::chrono::duration<double, RoboticArmMotion::Duration::period> exact_duration{
+      std::chrono::duration<double>{std::abs(to - from) / drive.speed}};
+    RoboticArmMotion::Duration duration{std::lround(exact_duration.count())};
+    if(duration.count() > 0) {
+      // Every motor has two directions (value 1 and 2), so the negative one is the other one.
+      auto negative = drive.positive == RoboticArmUsb::Action(1)
+        ? RoboticArmUsb::Action(2) : RoboticArmUsb::Action(1);
+      sequence.push_back(RoboticArmMotion::Step{
+          actuator, to > from ? drive.positive : negative, duration, {}});
+    }
+  }
+
+}
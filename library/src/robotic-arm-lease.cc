@@ -0,0 +1,166 @@
+//! Implementation of the actuator leases for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-lease.h>
+
+#include <stdexcept>
+
+
+namespace vijfendertig {
+
+  //! Create a lease which isn't acquired.
+  RoboticArmLease::RoboticArmLease():
+    robotic_arm_{nullptr},
+    mask_{0}
+  {}
+
+  //! Try to lease the given actuators.
+  /*!
+   *  The lease fails (and isAcquired() returns false) if one of the actuators is leased already.
+   *
+   *  \param robotic_arm Robotic arm to lease the actuators from (must outlive the lease).
+   *  \param actuators Actuators to lease.
+   *  \throws std::invalid_argument if no (valid) actuators are given.
+   */
+  RoboticArmLease::RoboticArmLease(RoboticArmUsb & robotic_arm,
+      const std::vector<RoboticArmUsb::Actuator> & actuators):
+    robotic_arm_{nullptr},
+    mask_{0}
+  {
+    for(auto actuator: actuators) {
+      if(!RoboticArmUsb::isCommandValid(actuator, RoboticArmUsb::Action(0))) {
+        throw std::invalid_argument("Invalid actuator for a robotic arm lease");
+      }
+      mask_ |= RoboticArmUsb::getActuatorMask(actuator);
+    }
+    if(mask_ == 0) {
+      throw std::invalid_argument("Empty robotic arm lease");
+    }
+    if(robotic_arm.acquireLease(mask_)) {
+      robotic_arm_ = &robotic_arm;
+    }
+  }
+
+  //! Take over another lease.
+  /*!
+   *  \param other Lease to take over (not acquired afterwards).
+   */
+  RoboticArmLease::RoboticArmLease(RoboticArmLease && other) noexcept:
+    robotic_arm_{other.robotic_arm_},
+    mask_{other.mask_}
+  {
+    other.robotic_arm_ = nullptr;
+  }
+
+  //! Release the lease (stopping its actuators).
+  RoboticArmLease::~RoboticArmLease()
+  {
+    release();
+  }
+
+  //! Release this lease and take over another one.
+  /*!
+   *  \param other Lease to take over (not acquired afterwards).
+   *  \return This lease.
+   */
+  RoboticArmLease & RoboticArmLease::operator=(RoboticArmLease && other) noexcept
+  {
+    if(this != &other) {
+      release();
+      robotic_arm_ = other.robotic_arm_;
+      mask_ = other.mask_;
+      other.robotic_arm_ = nullptr;
+    }
+    return *this;
+  }
+
+  //! Check whether the lease is acquired.
+  /*!
+   *  \return True if the lease's actuators are leased, false if not.
+   */
+  bool RoboticArmLease::isAcquired() const
+  {
+    return robotic_arm_ != nullptr;
+  }
+
+  //! Stop the lease's actuators and release them.
+  void RoboticArmLease::release()
+  {
+    if(robotic_arm_) {
+      robotic_arm_->releaseLease(mask_);
+      robotic_arm_ = nullptr;
+    }
+  }
+
+  //! Send a command to one of the lease's actuators.
+  /*!
+   *  \param actuator Actuator.
+   *  \param action Action.
+   *  \return kConnected on success, kInvalidCommand if the given command was not valid,
+   *      kLeaseConflict if the lease isn't acquired or doesn't include the actuator,
+   *      kEmergencyStop if the emergency stop is engaged or the robotic arm's status if it's not
+   *      connected.
+   */
+  RoboticArmUsb::Status RoboticArmLease::sendCommand(
+      RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action action)
+  {
+    if(!RoboticArmUsb::isCommandValid(actuator, action)) {
+      return RoboticArmUsb::Status::kInvalidCommand;
+    }
+    if(!robotic_arm_) {
+      return RoboticArmUsb::Status::kLeaseConflict;
+    }
+    return robotic_arm_->sendLeasedCommand(mask_, RoboticArmUsb::getActuatorMask(actuator),
+        RoboticArmUsb::updateCommandState(0, {{actuator, action}}));
+  }
+
+  //! Send a composite command to the lease's actuators.
+  /*!
+   *  \param commands Composite (actuator/action) command.
+   *  \return kConnected on success, kInvalidCommand if at least one of the given commands was not
+   *      valid, kLeaseConflict if the lease isn't acquired or doesn't include all actuators,
+   *      kEmergencyStop if the emergency stop is engaged or the robotic arm's status if it's not
+   *      connected.
+   */
+  RoboticArmUsb::Status RoboticArmLease::sendCommand(
+      const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands)
+  {
+    if(!RoboticArmUsb::isCommandValid(commands)) {
+      return RoboticArmUsb::Status::kInvalidCommand;
+    }
+    if(!robotic_arm_) {
+      return RoboticArmUsb::Status::kLeaseConflict;
+    }
+    RoboticArmUsb::Command mask{0};
+    for(const auto & command: commands) {
+      mask |= RoboticArmUsb::getActuatorMask(command.first);
+    }
+    return robotic_arm_->sendLeasedCommand(
+        mask_, mask, RoboticArmUsb::updateCommandState(0, commands));
+  }
+
+  //! Stop all of the lease's actuators.
+  /*!
+   *  \return kConnected on success, kLeaseConflict if the lease isn't acquired or the robotic
+   *      arm's status if it's not connected.
+   */
+  RoboticArmUsb::Status RoboticArmLease::sendStop()
+  {
+    if(!robotic_arm_) {
+      return RoboticArmUsb::Status::kLeaseConflict;
+    }
+    return robotic_arm_->sendLeasedCommand(mask_, mask_, 0);
+  }
+
+}
@@ -0,0 +1,250 @@
+//! Implementation of the motion sequence optimiser for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-motion.h>
+
+#include <algorithm>
+#include <limits>
+#include <set>
+#include <stdexcept>
+#include <string>
+
+
+namespace vijfendertig {
+
+  //! Schedule a motion sequence as authored, one step after the other.
+  /*!
+   *  This is the schedule an operator gets by sending every step and sleeping for its duration.
+   *  It's mainly useful as a reference for the optimised schedule.
+   *
+   *  \param sequence Motion sequence.
+   *  \return Schedule of command word transitions.
+   *  \throws std::invalid_argument if a step is not valid.
+   */
+  RoboticArmMotion::Schedule RoboticArmMotion::serialise(const Sequence & sequence)
+  {
+    validate(sequence);
+    std::vector<Duration::rep> start(sequence.size(), 0);
+    Duration::rep time{0};
+    for(std::size_t step = 0; step < sequence.size(); ++ step) {
+      start[step] = time;
+      time += sequence[step].duration.count();
+    }
+    return buildSchedule(sequence, start);
+  }
+
+  //! Schedule a motion sequence with independent steps running in parallel.
+  /*!
+   *  Steps on the same actuator keep their order, steps on different actuators only wait for the
+   *  steps listed in their dependencies. Every step is started as soon as its predecessors are
+   *  finished, which results in the minimal makespan (the length of the critical path). Steps
+   *  which are not on the critical path are then shifted within their slack to start or stop
+   *  together with other steps, which reduces the number of command word transitions without
+   *  increasing the makespan. The latter is a greedy pass: it never adds transitions, but it
+   *  doesn't guarantee the absolute minimum either.
+   *
+   *  \param sequence Motion sequence.
+   *  \return Schedule of command word transitions.
+   *  \throws std::invalid_argument if a step is not valid.
+   */
+  RoboticArmMotion::Schedule RoboticArmMotion::optimise(const Sequence & sequence)
+  {
+    validate(sequence);
+    std::size_t count{sequence.size()};
+    // Build the precedence graph: explicit dependencies and the previous step on the same
+    // actuator. All edges point from a lower to a higher index, so the index order is a
+    // topological order.
+    std::vector<std::vector<std::size_t>> predecessors(count), successors(count);
+    std::map<RoboticArmUsb::Actuator, std::size_t> last_step;
+    for(std::size_t step = 0; step < count; ++ step) {
+      std::set<std::size_t> step_predecessors{
+        sequence[step].dependencies.begin(), sequence[step].dependencies.end()};
+      auto last = last_step.find(sequence[step].actuator);
+      if(last != last_step.end()) {
+        step_predecessors.insert(last->second);
+      }
+      last_step[sequence[step].actuator] = step;
+      for(auto predecessor: step_predecessors) {
+        predecessors[step].push_back(predecessor);
+        successors[predecessor].push_back(step);
+      }
+    }
+    // Earliest start times (forward pass) and makespan.
+    std::vector<Duration::rep> earliest(count, 0);
+    Duration::rep makespan{0};
+    for(std::size_t step = 0; step < count; ++ step) {
+      for(auto predecessor: predecessors[step]) {
+        earliest[step] = std::max(earliest[step],
+            earliest[predecessor] + sequence[predecessor].duration.count());
+      }
+      makespan = std::max(makespan, earliest[step] + sequence[step].duration.count());
+    }
+    // Latest start times which don't increase the makespan (backward pass).
+    std::vector<Duration::rep> latest(count, 0);
+    for(std::size_t step = count; step -- > 0; ) {
+      Duration::rep finish{makespan};
+      for(auto successor: successors[step]) {
+        finish = std::min(finish, latest[successor]);
+      }
+      latest[step] = finish - sequence[step].duration.count();
+    }
+    // Place the steps in topological order. A step placed between its predecessors' actual
+    // finish and its latest start never pushes a successor beyond its own latest start.
+    std::set<Duration::rep> events{0, makespan};
+    std::vector<Duration::rep> start(count, 0);
+    for(std::size_t step = 0; step < count; ++ step) {
+      Duration::rep duration{sequence[step].duration.count()};
+      Duration::rep lower{0};
+      for(auto predecessor: predecessors[step]) {
+        lower = std::max(lower, start[predecessor] + sequence[predecessor].duration.count());
+      }
+      Duration::rep upper{latest[step]};
+      std::vector<Duration::rep> candidates{lower, upper};
+      for(auto event: events) {
+        candidates.push_back(event);
+        candidates.push_back(event - duration);
+      }
+      Duration::rep best_start{lower};
+      int best_cost{std::numeric_limits<int>::max()};
+      for(auto candidate: candidates) {
+        if(candidate < lower || candidate > upper) {
+          continue;
+        }
+        int cost = (events.count(candidate) ? 0 : 1) + (events.count(candidate + duration) ? 0 : 1);
+        if(cost < best_cost || (cost == best_cost && candidate < best_start)) {
+          best_cost = cost;
+          best_start = candidate;
+        }
+      }
+      start[step] = best_start;
+      if(duration > 0) {
+        events.insert(best_start);
+        events.insert(best_start + duration);
+      }
+    }
+    return buildSchedule(sequence, start);
+  }
+
+  //! Get the total duration of a schedule.
+  /*!
+   *  \param schedule Schedule of command word transitions.
+   *  \return Offset of the last transition (which stops the last running actuator).
+   */
+  RoboticArmMotion::Duration RoboticArmMotion::getMakespan(const Schedule & schedule)
+  {
+    return schedule.empty() ? Duration{0} : schedule.back().time;
+  }
+
+  //! Play a schedule on a robotic arm.
+  /*!
+   *  This function blocks until the schedule is finished, timed by the robotic arm's clock (see
+   *  RoboticArmUsb::getClock()), and the actuators got all their run time (which takes longer if
+   *  a motor budget is set, see RoboticArmUsb::setMotorBudget()). If sending a transition fails,
+   *  the actuators are stopped and the schedule is aborted.
+   *
+   *  \param robotic_arm Connected robotic arm.
+   *  \param schedule Schedule of command word transitions.
+   *  \return kConnected on success or the status of the failing RoboticArmUsb::sendCommand() or
+   *      RoboticArmUsb::waitForMotors() call.
+   */
+  RoboticArmUsb::Status RoboticArmMotion::play(
+      RoboticArmUsb & robotic_arm, const Schedule & schedule)
+  {
+    RoboticArmClock & clock = robotic_arm.getClock();
+    auto start = clock.now();
+    for(const auto & keyframe: schedule) {
+      clock.sleepUntil(start + keyframe.time);
+      auto status = robotic_arm.sendCommand(keyframe.commands);
+      if(status != RoboticArmUsb::Status::kConnected) {
+        robotic_arm.sendStop();
+        return status;
+      }
+    }
+    auto status = robotic_arm.waitForMotors();
+    if(status != RoboticArmUsb::Status::kConnected) {
+      robotic_arm.sendStop();
+    }
+    return status;
+  }
+
+  //! Verify whether all steps of a motion sequence are valid.
+  /*!
+   *  \param sequence Motion sequence.
+   *  \throws std::invalid_argument if a step has an invalid command, a negative duration or a
+   *      dependency on itself or a later step.
+   */
+  void RoboticArmMotion::validate(const Sequence & sequence)
+  {
+    for(std::size_t step = 0; step < sequence.size(); ++ step) {
+      if(!RoboticArmUsb::isCommandValid(sequence[step].actuator, sequence[step].action)) {
+        throw std::invalid_argument(
+            "Step " + std::to_string(step) + " of the motion sequence has an invalid command");
+      }
+      if(sequence[step].duration.count() < 0) {
+        throw std::invalid_argument(
+            "Step " + std::to_string(step) + " of the motion sequence has a negative duration");
+      }
+      for(auto dependency: sequence[step].dependencies) {
+        if(dependency >= step) {
+          throw std::invalid_argument("Step " + std::to_string(step) + " of the motion sequence "
+              "depends on step " + std::to_string(dependency) + ", which is not an earlier step");
+        }
+      }
+    }
+  }
+
+  //! Translate step start times into command word transitions.
+  /*!
+   *  \param sequence Motion sequence.
+   *  \param start Start time of every step (in Duration ticks).
+   *  \return Schedule with only the actuators which actually change state at every transition.
+   */
+  RoboticArmMotion::Schedule RoboticArmMotion::buildSchedule(
+      const Sequence & sequence, const std::vector<Duration::rep> & start)
+  {
+    // Stops first, so a step starting when the previous step on the same actuator finishes wins.
+    std::map<Duration::rep, std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action>> changes;
+    for(std::size_t step = 0; step < sequence.size(); ++ step) {
+      if(sequence[step].duration.count() > 0) {
+        changes[start[step] + sequence[step].duration.count()][sequence[step].actuator] =
+          RoboticArmUsb::Action::kStop;
+      }
+    }
+    for(std::size_t step = 0; step < sequence.size(); ++ step) {
+      if(sequence[step].duration.count() > 0) {
+        changes[start[step]][sequence[step].actuator] = sequence[step].action;
+      }
+    }
+    // Drop changes which don't change the command word.
+    Schedule schedule;
+    std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> state;
+    for(const auto & change: changes) {
+      Keyframe keyframe{Duration{change.first}, {}};
+      for(const auto & command: change.second) {
+        auto current = state.find(command.first);
+        auto current_action =
+          current == state.end() ? RoboticArmUsb::Action::kStop : current->second;
+        if(current_action != command.second) {
+          keyframe.commands.insert(command);
+          state[command.first] = command.second;
+        }
+      }
+      if(!keyframe.commands.empty()) {
+        schedule.push_back(keyframe);
+      }
+    }
+    return schedule;
+  }
+
+}
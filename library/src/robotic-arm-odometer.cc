@@ -0,0 +1,290 @@
+//! Implementation of the motor odometer for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-odometer.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace vijfendertig {
+
+  constexpr std::size_t RoboticArmOdometer::kActuatorCount;
+
+  const std::array<RoboticArmUsb::Actuator, RoboticArmOdometer::kActuatorCount>
+    RoboticArmOdometer::actuators_{{RoboticArmUsb::Actuator::kGripper,
+      RoboticArmUsb::Actuator::kWrist, RoboticArmUsb::Actuator::kElbow,
+      RoboticArmUsb::Actuator::kShoulder, RoboticArmUsb::Actuator::kBase,
+      RoboticArmUsb::Actuator::kLight}};
+
+  //! Get the counters of an actuator.
+  /*!
+   *  \param actuator Actuator.
+   *  \return Counters of the actuator.
+   */
+  const RoboticArmOdometer::Counters & RoboticArmOdometer::Snapshot::get(
+      RoboticArmUsb::Actuator actuator) const
+  {
+    return actuators[getIndex(actuator)];
+  }
+
+  //! Create an odometer with all counters at zero.
+  /*!
+   *  \param clock Clock to take the time from.
+   */
+  RoboticArmOdometer::RoboticArmOdometer(std::shared_ptr<RoboticArmClock> clock):
+    clock_{clock ? clock : RoboticArmClock::getSystemClock()},
+    counters_{},
+    command_state_{0},
+    run_start_{},
+    persistence_thread_{},
+    persistence_stop_requested_{false}
+  {}
+
+  //! Destroy an odometer (saving the counters one last time if they're persisted).
+  RoboticArmOdometer::~RoboticArmOdometer()
+  {
+    stopPersistence();
+  }
+
+  //! Get the current counters.
+  /*!
+   *  The run time of running actuators includes their current run.
+   *
+   *  \return Counters of all actuators.
+   */
+  RoboticArmOdometer::Snapshot RoboticArmOdometer::getSnapshot() const
+  {
+    auto now = clock_->now();
+    std::lock_guard<std::mutex> lock{mutex_};
+    Snapshot snapshot = counters_;
+    for(std::size_t index = 0; index < kActuatorCount; ++ index) {
+      unsigned direction = (command_state_ >> uint8_t(actuators_[index])) & 0x03;
+      if(direction != 0) {
+        snapshot.actuators[index].run_time[direction - 1] += now - run_start_[index];
+      }
+    }
+    return snapshot;
+  }
+
+  //! Load the counters from a file.
+  /*!
+   *  Call this function before connecting, as the loaded counters replace the current ones.
+   *
+   *  \param path Path of the file (as written by save()).
+   *  \return True on success, false if the file can't be read or is invalid (the counters are
+   *      not changed in that case).
+   */
+  bool RoboticArmOdometer::load(const std::string & path)
+  {
+    std::ifstream file{path};
+    std::string header;
+    if(!std::getline(file, header) || header != "robotic-arm-odometer 1") {
+      std::cerr << "The robotic arm's odometer file '" << path << "' can't be read." << std::endl;
+      return false;
+    }
+    Snapshot snapshot{};
+    for(auto & counters: snapshot.actuators) {
+      int64_t run_time_1, run_time_2;
+      if(!(file >> run_time_1 >> run_time_2 >> counters.starts >> counters.reversals)) {
+        std::cerr << "The robotic arm's odometer file '" << path << "' is invalid." << std::endl;
+        return false;
+      }
+      counters.run_time = {{std::chrono::nanoseconds{run_time_1},
+        std::chrono::nanoseconds{run_time_2}}};
+    }
+    auto now = clock_->now();
+    std::lock_guard<std::mutex> lock{mutex_};
+    counters_ = snapshot;
+    run_start_.fill(now);
+    return true;
+  }
+
+  //! Save the counters to a file, atomically replacing it.
+  /*!
+   *  The counters are written to a temporary file (the path with ".tmp" appended), which is
+   *  synced to disk and renamed to the path. The directory is synced afterwards to make the
+   *  rename itself durable, so the file always holds a complete set of counters, even after a
+   *  crash or a power failure.
+   *
+   *  \param path Path of the file.
+   *  \return True on success, false on failure.
+   */
+  bool RoboticArmOdometer::save(const std::string & path) const
+  {
+    auto snapshot = getSnapshot();
+    std::ostringstream contents;
+    contents << "robotic-arm-odometer 1\n";
+    for(const auto & counters: snapshot.actuators) {
+      contents << counters.run_time[0].count() << " " << counters.run_time[1].count() << " "
+        << counters.starts << " " << counters.reversals << "\n";
+    }
+    std::string data{contents.str()};
+    std::string temporary_path{path + ".tmp"};
+    int descriptor = open(temporary_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool success = descriptor >= 0;
+    for(std::size_t written = 0; success && written < data.size(); ) {
+      ssize_t size = write(descriptor, data.data() + written, data.size() - written);
+      if(size < 0 && errno != EINTR) {
+        success = false;
+      }
+      else if(size > 0) {
+        written += size;
+      }
+    }
+    success = success && fsync(descriptor) == 0;
+    if(descriptor >= 0) {
+      success = close(descriptor) == 0 && success;
+    }
+    success = success && std::rename(temporary_path.c_str(), path.c_str()) == 0;
+    if(success) {
+      std::string::size_type separator = path.find_last_of('/');
+      std::string directory{separator == std::string::npos
+        ? "." : separator == 0 ? "/" : path.substr(0, separator)};
+      int directory_descriptor = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      success = directory_descriptor >= 0 && fsync(directory_descriptor) == 0;
+      if(directory_descriptor >= 0) {
+        close(directory_descriptor);
+      }
+    }
+    if(!success) {
+      std::cerr << "An error occured while saving the robotic arm's odometer file '" << path
+        << "': " << std::strerror(errno) << "." << std::endl;
+    }
+    return success;
+  }
+
+  //! Persist the counters periodically.
+  /*!
+   *  The counters are loaded from the file first (if it exists), so the totals continue where
+   *  the previous run stopped. A separate thread saves them every interval (on the odometer's
+   *  clock) and once more when the persistence is stopped, so the control path never waits for
+   *  the disk.
+   *
+   *  \param path Path of the file.
+   *  \param interval Time between two saves.
+   *  \throws std::invalid_argument if the interval is not positive.
+   *  \throws std::logic_error if the counters are persisted already.
+   */
+  void RoboticArmOdometer::startPersistence(
+      const std::string & path, RoboticArmClock::Duration interval)
+  {
+    if(interval <= RoboticArmClock::Duration::zero()) {
+      throw std::invalid_argument("Invalid persistence interval for the robotic arm's odometer");
+    }
+    if(persistence_thread_.joinable()) {
+      throw std::logic_error("The robotic arm's odometer is persisted already");
+    }
+    if(access(path.c_str(), F_OK) == 0) {
+      load(path);
+    }
+    persistence_stop_requested_ = false;
+    persistence_thread_ = std::thread(&RoboticArmOdometer::persistenceThread, this, path, interval);
+  }
+
+  //! Stop persisting the counters, after saving them one last time.
+  void RoboticArmOdometer::stopPersistence()
+  {
+    if(persistence_thread_.joinable()) {
+      { // lock_guard scope.
+        std::lock_guard<std::mutex> lock{persistence_mutex_};
+        persistence_stop_requested_ = true;
+      }
+      persistence_stop_.notify_all();
+      persistence_thread_.join();
+    }
+  }
+
+  //! Get the index of an actuator's counters.
+  /*!
+   *  \param actuator Actuator.
+   *  \return Index in Snapshot::actuators.
+   *  \throws std::invalid_argument if the actuator is not valid.
+   */
+  std::size_t RoboticArmOdometer::getIndex(RoboticArmUsb::Actuator actuator)
+  {
+    for(std::size_t index = 0; index < kActuatorCount; ++ index) {
+      if(actuators_[index] == actuator) {
+        return index;
+      }
+    }
+    throw std::invalid_argument("Invalid actuator for the robotic arm's odometer");
+  }
+
+  //! Account a command word which was sent to the USB interface.
+  /*!
+   *  Only the actuators whose 2-bit field changed are updated, so this costs a clock read and a
+   *  few bit operations per transfer.
+   *
+   *  \param command_state Raw command word.
+   */
+  void RoboticArmOdometer::update(uint32_t command_state)
+  {
+    auto now = clock_->now();
+    std::lock_guard<std::mutex> lock{mutex_};
+    uint32_t changed = command_state ^ command_state_;
+    for(std::size_t index = 0; changed != 0 && index < kActuatorCount; ++ index) {
+      uint8_t shift = uint8_t(actuators_[index]);
+      unsigned previous = (command_state_ >> shift) & 0x03;
+      unsigned current = (command_state >> shift) & 0x03;
+      if(previous == current) {
+        continue;
+      }
+      Counters & counters = counters_.actuators[index];
+      if(previous != 0) {
+        counters.run_time[previous - 1] += now - run_start_[index];
+      }
+      if(current != 0) {
+        run_start_[index] = now;
+        if(previous == 0) {
+          ++ counters.starts;
+        }
+        else {
+          ++ counters.reversals;
+        }
+      }
+    }
+    command_state_ = command_state;
+  }
+
+  //! Save the counters periodically until stopPersistence() is called.
+  /*!
+   *  \param path Path of the file.
+   *  \param interval Time between two saves.
+   */
+  void RoboticArmOdometer::persistenceThread(std::string path, RoboticArmClock::Duration interval)
+  {
+    auto deadline = clock_->now() + interval;
+    std::unique_lock<std::mutex> lock{persistence_mutex_};
+    while(!persistence_stop_requested_) {
+      clock_->waitUntil(persistence_stop_, lock, deadline);
+      if(!persistence_stop_requested_ && clock_->now() >= deadline) {
+        lock.unlock();
+        save(path);
+        lock.lock();
+        deadline += interval;
+      }
+    }
+    lock.unlock();
+    save(path);
+  }
+
+}
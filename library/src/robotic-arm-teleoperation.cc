@@ -0,0 +1,334 @@
+//! Implementation of the joystick teleoperation for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-teleoperation.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+
+namespace vijfendertig {
+
+  //! Create a teleoperation which controls the given robotic arm.
+  /*!
+   *  \param robotic_arm Robotic arm to send the commands to (must outlive the teleoperation).
+   */
+  RoboticArmTeleoperation::RoboticArmTeleoperation(RoboticArmUsb & robotic_arm):
+    RoboticArmTeleoperation([&robotic_arm](const Commands & commands) {
+        return robotic_arm.sendCommand(commands);
+      })
+  {}
+
+  //! Create a teleoperation which submits its commands to the given function.
+  /*!
+   *  \param submit Function to submit composite commands with (to benchmark without a robotic
+   *      arm for example).
+   *  \throws std::invalid_argument if the function is empty.
+   */
+  RoboticArmTeleoperation::RoboticArmTeleoperation(Submit submit):
+    submit_{submit},
+    axes_{},
+    buttons_{},
+    submitted_{},
+    report_pending_{false},
+    report_dropped_{false},
+    stop_requested_{false},
+    events_{0},
+    reports_{0},
+    submissions_{0},
+    total_latency_{0},
+    max_latency_{0}
+  {
+    if(!submit_) {
+      throw std::invalid_argument("Invalid submit function for the robotic arm's teleoperation");
+    }
+  }
+
+  //! Map an absolute axis to an actuator.
+  /*!
+   *  \param mapping Axis mapping.
+   *  \throws std::invalid_argument if the deadband or the hysteresis is negative, the actuator is
+   *      not a motor (an axis needs two directions) or the positive action doesn't move it.
+   */
+  void RoboticArmTeleoperation::addAxis(const AxisMapping & mapping)
+  {
+    if(mapping.deadband < 0 || mapping.hysteresis < 0
+        || mapping.actuator == RoboticArmUsb::Actuator::kLight
+        || !RoboticArmUsb::isCommandValid(mapping.actuator, mapping.positive)
+        || mapping.positive == RoboticArmUsb::Action(0)) {
+      throw std::invalid_argument("Invalid axis mapping for the robotic arm's teleoperation");
+    }
+    axes_.push_back(Axis{mapping, mapping.centre, 0});
+  }
+
+  //! Map a button to an actuator.
+  /*!
+   *  \param mapping Button mapping.
+   *  \throws std::invalid_argument if the action is not valid for the actuator.
+   */
+  void RoboticArmTeleoperation::addButton(const ButtonMapping & mapping)
+  {
+    if(!RoboticArmUsb::isCommandValid(mapping.actuator, mapping.action)) {
+      throw std::invalid_argument("Invalid button mapping for the robotic arm's teleoperation");
+    }
+    buttons_.push_back(Button{mapping, false});
+  }
+
+  //! Process a single input event.
+  /*!
+   *  Axis and button events update the input state, which is evaluated at the next
+   *  synchronisation report. When the kernel reports dropped events (SYN_DROPPED), the input
+   *  state is unknown, so all mapped actuators are stopped and the events up to the next report
+   *  are ignored.
+   *
+   *  \param event Input event.
+   *  \return Status of the submitted command or kConnected if nothing was submitted.
+   */
+  RoboticArmUsb::Status RoboticArmTeleoperation::processEvent(const struct input_event & event)
+  {
+    events_.fetch_add(1, std::memory_order_relaxed);
+    if(event.type == EV_SYN) {
+      if(event.code == SYN_REPORT) {
+        reports_.fetch_add(1, std::memory_order_relaxed);
+        if(report_dropped_) {
+          report_dropped_ = false;
+          return RoboticArmUsb::Status::kConnected;
+        }
+        else if(report_pending_) {
+          report_pending_ = false;
+          return evaluateReport();
+        }
+      }
+      else if(event.code == SYN_DROPPED) {
+        report_dropped_ = true;
+        for(auto & axis: axes_) {
+          axis.value = axis.mapping.centre;
+          axis.direction = 0;
+        }
+        for(auto & button: buttons_) {
+          button.pressed = false;
+        }
+        return evaluateReport();
+      }
+    }
+    else if(report_dropped_) {
+      // Ignore the events up to the next report after dropped events.
+    }
+    else if(event.type == EV_ABS) {
+      for(auto & axis: axes_) {
+        if(axis.mapping.code == event.code) {
+          int32_t offset = event.value - axis.mapping.centre;
+          int32_t release = std::max(0, axis.mapping.deadband - axis.mapping.hysteresis);
+          int8_t direction = axis.direction;
+          if(offset > axis.mapping.deadband) {
+            direction = 1;
+          }
+          else if(offset < - axis.mapping.deadband) {
+            direction = -1;
+          }
+          // The release band applies per side: leaving the running direction's side stops it.
+          else if((direction > 0 && offset <= release) || (direction < 0 && offset >= - release)) {
+            direction = 0;
+          }
+          axis.value = event.value;
+          report_pending_ = report_pending_ || direction != axis.direction;
+          axis.direction = direction;
+        }
+      }
+    }
+    else if(event.type == EV_KEY && event.value != 2) {
+      // Value 2 is an auto-repeat, which doesn't change the button's state.
+      for(auto & button: buttons_) {
+        if(button.mapping.code == event.code) {
+          report_pending_ = report_pending_ || button.pressed != (event.value != 0);
+          button.pressed = event.value != 0;
+        }
+      }
+    }
+    return RoboticArmUsb::Status::kConnected;
+  }
+
+  //! Read and process input events from a file descriptor until end of file or stop().
+  /*!
+   *  \param descriptor File descriptor of an evdev device or a recording of one.
+   *  \return kConnected at end of file or after stop(), kIoError if reading failed or the status
+   *      of the first command which was not submitted successfully.
+   */
+  RoboticArmUsb::Status RoboticArmTeleoperation::run(int descriptor)
+  {
+    stop_requested_ = false;
+    struct input_event events[64];
+    while(!stop_requested_) {
+      struct pollfd poll_descriptor{descriptor, POLLIN, 0};
+      int ready = poll(&poll_descriptor, 1, poll_interval_ms_);
+      if(ready < 0 && errno != EINTR) {
+        std::cerr << "An error occured while waiting for input events: "
+          << std::strerror(errno) << "." << std::endl;
+        return RoboticArmUsb::Status::kIoError;
+      }
+      else if(ready <= 0) {
+        continue;
+      }
+      ssize_t size = read(descriptor, events, sizeof(events));
+      if(size < 0) {
+        if(errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        std::cerr << "An error occured while reading input events: "
+          << std::strerror(errno) << "." << std::endl;
+        return RoboticArmUsb::Status::kIoError;
+      }
+      else if(size == 0) {
+        break;
+      }
+      // A truncated event can only occur at the end of a recording, so it's ignored.
+      for(std::size_t index = 0; index < std::size_t(size) / sizeof(events[0]); ++ index) {
+        RoboticArmUsb::Status status = processEvent(events[index]);
+        if(status != RoboticArmUsb::Status::kConnected) {
+          return status;
+        }
+      }
+    }
+    return RoboticArmUsb::Status::kConnected;
+  }
+
+  //! Read and process all input events of a recording (or an evdev device).
+  /*!
+   *  Recordings are processed as fast as possible, to benchmark the teleoperation.
+   *
+   *  \param path Path to the recording (raw input_event structures) or device.
+   *  \return See run().
+   *  \throws std::runtime_error if the file can't be opened.
+   */
+  RoboticArmUsb::Status RoboticArmTeleoperation::play(const std::string & path)
+  {
+    int descriptor = open(path.c_str(), O_RDONLY);
+    if(descriptor < 0) {
+      std::string message{"An error occured while opening input events '" + path + "': "
+        + std::strerror(errno)};
+      std::cerr << message << "." << std::endl;
+      throw std::runtime_error(message);
+    }
+    RoboticArmUsb::Status status = run(descriptor);
+    close(descriptor);
+    return status;
+  }
+
+  //! Make run() (or play()) return after the events it's processing.
+  /*!
+   *  This function can be called from any thread.
+   */
+  void RoboticArmTeleoperation::stop()
+  {
+    stop_requested_ = true;
+  }
+
+  //! Get the teleoperation statistics.
+  /*!
+   *  This function can be called from any thread.
+   *
+   *  \return Number of events, reports and submissions and the submission latencies.
+   */
+  RoboticArmTeleoperation::Statistics RoboticArmTeleoperation::getStatistics() const
+  {
+    return Statistics{events_, reports_, submissions_,
+      std::chrono::nanoseconds{total_latency_}, std::chrono::nanoseconds{max_latency_}};
+  }
+
+  //! Calculate the suppression ratio of the teleoperation.
+  /*!
+   *  \param statistics Teleoperation statistics.
+   *  \return Fraction of the input events which didn't result in a submitted command (a naive
+   *      loop would send a command for every event).
+   */
+  double RoboticArmTeleoperation::getSuppressionRatio(const Statistics & statistics)
+  {
+    if(statistics.events == 0) {
+      return 0.0;
+    }
+    return 1.0 - double(statistics.submissions) / statistics.events;
+  }
+
+  //! Calculate the actions of all mapped actuators from the input state.
+  /*!
+   *  If multiple axes or buttons are mapped to the same actuator, the first one (in the order
+   *  they were added) which isn't at rest wins.
+   *
+   *  \return Action of every mapped actuator.
+   */
+  RoboticArmTeleoperation::Commands RoboticArmTeleoperation::getCommands() const
+  {
+    Commands commands;
+    for(const auto & axis: axes_) {
+      auto & action =
+        commands.emplace(axis.mapping.actuator, RoboticArmUsb::Action(0)).first->second;
+      if(action == RoboticArmUsb::Action(0) && axis.direction != 0) {
+        // Every motor has two directions (value 1 and 2), so the negative one is the other one.
+        action = axis.direction > 0 ? axis.mapping.positive
+          : RoboticArmUsb::Action(3 - uint8_t(axis.mapping.positive));
+      }
+    }
+    for(const auto & button: buttons_) {
+      auto & action =
+        commands.emplace(button.mapping.actuator, RoboticArmUsb::Action(0)).first->second;
+      if(action == RoboticArmUsb::Action(0) && button.pressed) {
+        action = button.mapping.action;
+      }
+    }
+    return commands;
+  }
+
+  //! Submit the actuators whose action changed since the last submitted command.
+  /*!
+   *  \return Status of the submitted command or kConnected if nothing changed.
+   */
+  RoboticArmUsb::Status RoboticArmTeleoperation::evaluateReport()
+  {
+    auto start = std::chrono::steady_clock::now();
+    Commands changes;
+    for(const auto & command: getCommands()) {
+      // The actuators are assumed to be stopped before the first submission.
+      auto submitted = submitted_.find(command.first);
+      auto previous = submitted == submitted_.end() ? RoboticArmUsb::Action(0) : submitted->second;
+      if(command.second != previous) {
+        changes.insert(command);
+      }
+    }
+    if(changes.empty()) {
+      return RoboticArmUsb::Status::kConnected;
+    }
+    RoboticArmUsb::Status status = submit_(changes);
+    if(status == RoboticArmUsb::Status::kConnected) {
+      for(const auto & change: changes) {
+        submitted_[change.first] = change.second;
+      }
+    }
+    int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    submissions_.fetch_add(1, std::memory_order_relaxed);
+    total_latency_.fetch_add(latency, std::memory_order_relaxed);
+    int64_t max_latency = max_latency_.load(std::memory_order_relaxed);
+    while(latency > max_latency
+        && !max_latency_.compare_exchange_weak(max_latency, latency, std::memory_order_relaxed)) {
+    }
+    return status;
+  }
+
+}
@@ -0,0 +1,242 @@
+//! Implementation of the control path tracer for the Velleman/OWI Robotic Arm.
+/*!
+ *  \file
+ *  \author Maarten De Munck, <maarten@vijfendertig.be>
+ *  \date 2017
+ *  \copyright Licensed under the MIT License. See LICENSE for the full license.
+ */
+
+
+#if __cplusplus < 201103L
+  #error "The robotic arm interface requires at least a C++11 compliant compiler."
+#endif
+
+
+#include <robotic-arm-trace.h>
+
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+namespace vijfendertig {
+
+  //! Span buffer of a single thread at a time.
+  /*!
+   *  Only the owning thread appends spans (and allocates chunks). The size is published with
+   *  release semantics after the span itself (and its chunk) is written, so an exporting thread
+   *  can read all spans up to the size it loads (with acquire semantics) without locking. Every
+   *  thread taking over the buffer starts a new track at the current size, so the spans of the
+   *  previous owners keep their own track.
+   */
+  struct RoboticArmTrace::Buffer {
+    //! Recorded span.
+    struct Event {
+      const char * name;       //!< Span name.
+      Clock::time_point begin; //!< Span start time.
+      Clock::time_point end;   //!< Span end time.
+    };
+
+    explicit Buffer(std::size_t thread):
+      tracks{{0, thread}},
+      size{0},
+      owned{true}
+    {}
+
+    //! Get a recorded span (its chunk must be allocated).
+    Event & operator[](std::size_t index)
+    {
+      return chunks[index / chunk_capacity_][index % chunk_capacity_];
+    }
+
+    //! First span and track number of every owning thread (protected by the registry's mutex).
+    std::vector<std::pair<std::size_t, std::size_t>> tracks;
+    //! Span storage, allocated one chunk at a time.
+    std::unique_ptr<Event[]> chunks[buffer_capacity_ / chunk_capacity_];
+    std::atomic<std::size_t> size; //!< Number of valid spans.
+    bool owned;                    //!< Owned by a thread (protected by the registry's mutex).
+  };
+
+  //! Registry of all thread buffers (they outlive their threads, so they can be exported).
+  struct RoboticArmTrace::Registry {
+    std::mutex mutex;                             //!< Mutex to protect the buffer list.
+    std::vector<std::shared_ptr<Buffer>> buffers; //!< Buffers of all threads that ever recorded.
+    std::atomic<std::uint64_t> dropped{0};        //!< Number of spans dropped on full buffers.
+    std::size_t threads{0};                       //!< Number of threads that ever recorded.
+  };
+
+  std::atomic<bool> RoboticArmTrace::enabled_{false};
+
+
+  //! Start recording spans.
+  void RoboticArmTrace::enable()
+  {
+    enabled_.store(true, std::memory_order_relaxed);
+  }
+
+  //! Stop recording spans. Spans which are already recorded are kept until clear() is called.
+  void RoboticArmTrace::disable()
+  {
+    enabled_.store(false, std::memory_order_relaxed);
+  }
+
+  //! Record a span in the calling thread's buffer.
+  /*!
+   *  The first call in every thread takes over the buffer of an exited thread, or registers a new
+   *  buffer. All subsequent calls are lock-free. A chunk is allocated every chunk_capacity_ spans
+   *  (unless the buffer's previous owner already did). If the buffer is full (or the chunk can't
+   *  be allocated), the span is dropped and counted.
+   *
+   *  \param name Span name. Must be a string literal (only the pointer is recorded).
+   *  \param begin Span start time.
+   *  \param end Span end time.
+   */
+  void RoboticArmTrace::record(const char * name, Clock::time_point begin, Clock::time_point end)
+  {
+    Buffer & buffer = getThreadBuffer();
+    std::size_t size = buffer.size.load(std::memory_order_relaxed);
+    if(size >= buffer_capacity_) {
+      getRegistry().dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    auto & chunk = buffer.chunks[size / chunk_capacity_];
+    if(!chunk) {
+      // Called from span destructors, so an allocation failure mustn't throw.
+      chunk.reset(new(std::nothrow) Buffer::Event[chunk_capacity_]);
+      if(!chunk) {
+        getRegistry().dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+    buffer[size] = Buffer::Event{name, begin, end};
+    buffer.size.store(size + 1, std::memory_order_release);
+  }
+
+  //! Discard all recorded spans.
+  /*!
+   *  Only call this function while tracing is disabled and no spans are being recorded.
+   */
+  void RoboticArmTrace::clear()
+  {
+    Registry & registry = getRegistry();
+    std::lock_guard<std::mutex> lock{registry.mutex};
+    for(const auto & buffer: registry.buffers) {
+      buffer->size.store(0, std::memory_order_relaxed);
+      // Only the current (or last) owner's track remains.
+      buffer->tracks.erase(buffer->tracks.begin(), buffer->tracks.end() - 1);
+      buffer->tracks.front().first = 0;
+    }
+    registry.dropped.store(0, std::memory_order_relaxed);
+  }
+
+  //! Get the number of spans dropped because a thread's buffer was full.
+  /*!
+   *  \return Number of dropped spans since the last clear() call.
+   */
+  std::uint64_t RoboticArmTrace::getDroppedCount()
+  {
+    return getRegistry().dropped.load(std::memory_order_relaxed);
+  }
+
+  //! Export all recorded spans as Chrome trace-event JSON.
+  /*!
+   *  Spans are written as complete ("X") events with microsecond timestamps. Every recording
+   *  thread gets its own track. The export may run while other threads are still recording;
+   *  spans recorded after a buffer was visited are simply not included.
+   *
+   *  \param stream Output stream to write the JSON document to.
+   */
+  void RoboticArmTrace::writeChromeTrace(std::ostream & stream)
+  {
+    Registry & registry = getRegistry();
+    std::lock_guard<std::mutex> lock{registry.mutex};
+    auto flags = stream.flags();
+    auto precision = stream.precision();
+    stream << std::fixed << std::setprecision(3);
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first{true};
+    for(const auto & buffer_pointer: registry.buffers) {
+      Buffer & buffer = *buffer_pointer;
+      std::size_t size = buffer.size.load(std::memory_order_acquire);
+      auto track = buffer.tracks.begin();
+      for(std::size_t index = 0; index < size; ++ index) {
+        while(track + 1 != buffer.tracks.end() && (track + 1)->first <= index) {
+          ++ track;
+        }
+        const Buffer::Event & event = buffer[index];
+        double begin = std::chrono::duration<double, std::micro>(
+            event.begin.time_since_epoch()).count();
+        double duration = std::chrono::duration<double, std::micro>(
+            event.end - event.begin).count();
+        stream << (first ? "" : ",") << "\n{\"name\":\"" << event.name
+          << "\",\"cat\":\"robotic-arm-usb\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track->second
+          << ",\"ts\":" << begin << ",\"dur\":" << duration << "}";
+        first = false;
+      }
+    }
+    stream << "\n]}" << std::endl;
+    stream.flags(flags);
+    stream.precision(precision);
+  }
+
+  //! Get the registry of all thread buffers.
+  /*!
+   *  \return Registry (constructed on first use).
+   */
+  RoboticArmTrace::Registry & RoboticArmTrace::getRegistry()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  //! Get (and take over or create on first use) the calling thread's span buffer.
+  /*!
+   *  The buffer is handed back to the registry when the thread exits, so the next thread which
+   *  records a span continues in it (on a new track) instead of allocating a new one.
+   *
+   *  \return Span buffer owned by the calling thread.
+   */
+  RoboticArmTrace::Buffer & RoboticArmTrace::getThreadBuffer()
+  {
+    //! Owner of the calling thread's buffer, releasing it when the thread exits.
+    struct Owner {
+      Buffer * buffer{nullptr};
+
+      ~Owner()
+      {
+        if(buffer != nullptr) {
+          Registry & registry = getRegistry();
+          std::lock_guard<std::mutex> lock{registry.mutex};
+          buffer->owned = false;
+        }
+      }
+    };
+    thread_local Owner owner;
+    if(owner.buffer == nullptr) {
+      Registry & registry = getRegistry();
+      std::lock_guard<std::mutex> lock{registry.mutex};
+      for(const auto & buffer: registry.buffers) {
+        if(!buffer->owned) {
+          buffer->owned = true;
+          // Replace the previous owner's track if it has no spans (any more).
+          std::size_t size = buffer->size.load(std::memory_order_relaxed);
+          if(buffer->tracks.back().first == size) {
+            buffer->tracks.pop_back();
+          }
+          buffer->tracks.emplace_back(size, ++ registry.threads);
+          owner.buffer = buffer.get();
+          break;
+        }
+      }
+      if(owner.buffer == nullptr) {
+        registry.buffers.push_back(std::make_shared<Buffer>(++ registry.threads));
+        owner.buffer = registry.buffers.back().get();
+      }
+    }
+    return *owner.buffer;
+  }
+
+}
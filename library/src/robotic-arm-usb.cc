@@ -13,14 +13,27 @@
 
 
 #include <robotic-arm-usb.h>
+#include <robotic-arm-motion.h>
+#include <robotic-arm-odometer.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+  #include <sys/eventfd.h>
+#endif
 
 
 namespace vijfendertig {
 
+  constexpr std::size_t RoboticArmUsb::kLatencyBuckets;
+  const int64_t RoboticArmUsb::group_timeout_;
+
   //! Create a new robotic arm controller object.
   /*!
    *  This function initialises the robotic arm controller object and the libusb library. It will
@@ -28,11 +41,74 @@ namespace vijfendertig {
    *  that).
    */
   RoboticArmUsb::RoboticArmUsb():
+    RoboticArmUsb(RoboticArmClock::getSystemClock())
+  {}
+
+  //! Create a new robotic arm controller object with the given clock.
+  /*!
+   *  All timed behaviour of the controller (and the features built on top of it) takes its time
+   *  from the given clock, so tests can inject a RoboticArmVirtualClock.
+   *
+   *  \param clock Clock to use.
+   */
+  RoboticArmUsb::RoboticArmUsb(std::shared_ptr<RoboticArmClock> clock):
+    clock_{clock ? clock : RoboticArmClock::getSystemClock()},
+    odometer_{new RoboticArmOdometer(clock_)},
     libusb_context_{nullptr},
     libusb_device_handle_{nullptr},
+    transfer_ready_{false},
     connection_state_{Status::kDisconnected},
-    command_state_{0}
+    command_state_{0},
+    command_state_sent_{0},
+    lease_mask_{0},
+    leased_command_state_{0},
+    control_waiting_{false},
+    control_notified_{},
+    emergency_stop_{false},
+    emergency_stop_requested_{0},
+    emergency_stop_count_{0},
+    emergency_stop_last_latency_{0},
+    emergency_stop_max_latency_{0},
+    statistics_commands_{0},
+    statistics_transfers_{0},
+    statistics_transfer_errors_{0},
+    statistics_command_state_{0},
+    events_enabled_{false},
+    event_descriptor_{-1},
+    event_write_descriptor_{-1},
+    events_{},
+    events_dropped_{0},
+    watchdog_timeout_{default_watchdog_timeout_},
+    transfer_timeout_{default_transfer_timeout_},
+    journal_{},
+    journal_capacity_{0},
+    journal_overflow_{false},
+    motor_budget_{0},
+    motor_quantum_{std::chrono::milliseconds{100}},
+    motor_weights_{{Actuator::kGripper, 1}, {Actuator::kWrist, 1}, {Actuator::kElbow, 1},
+      {Actuator::kShoulder, 1}, {Actuator::kBase, 1}, {Actuator::kLight, 0}},
+    motor_scheduling_{false},
+    motor_granted_{0},
+    motor_next_{0},
+    motor_slice_end_{RoboticArmClock::TimePoint::max()},
+    motor_deadline_{RoboticArmClock::TimePoint::max()},
+    motor_accounted_{},
+    motor_requested_{0},
+    motor_demanded_{0},
+    motor_running_{0},
+    motor_backlog_{},
+    motor_idle_{},
+    motor_statistics_{},
+    group_rendezvous_{},
+    group_index_{0}
   {
+    for(auto & bucket: statistics_transfer_latency_) {
+      bucket.store(0, std::memory_order_relaxed);
+    }
+    for(const auto & weight: motor_weights_) {
+      motor_statistics_[weight.first] = MotorStatistics{};
+      motor_backlog_[weight.first];
+    }
     // Initialise libusb.
     int error = libusb_init(&libusb_context_);
     if(error != LIBUSB_SUCCESS) {
@@ -53,6 +129,13 @@ namespace vijfendertig {
   {
     // Disconnect robotic arm.
     disconnect();
+    // Close the event descriptor(s).
+    if(event_write_descriptor_ >= 0 && event_write_descriptor_ != event_descriptor_) {
+      close(event_write_descriptor_);
+    }
+    if(event_descriptor_ >= 0) {
+      close(event_descriptor_);
+    }
     // Deinitialize libusb.
     if(libusb_context_ != nullptr) {
       libusb_exit(libusb_context_);
@@ -170,6 +253,7 @@ namespace vijfendertig {
         }
       }
       libusb_free_device_list(device_list, 1);
+      pushEvent(EventType::kStatusChanged, connection_state_return);
     }
     return connection_state_return;
   }
@@ -195,7 +279,7 @@ namespace vijfendertig {
       {
         std::lock_guard<std::mutex> lock{control_pending_mutex_};
         connection_state_ = Status::kDisconnecting;
-        control_pending_.notify_all();
+        notifyControlThread();
       }
       if(control_thread_.joinable()) {
         control_thread_.join();
@@ -208,6 +292,8 @@ namespace vijfendertig {
       libusb_release_interface(libusb_device_handle_, 0);
       libusb_close(libusb_device_handle_);
       libusb_device_handle_ = nullptr;
+      connection_state_ = Status::kDisconnected;
+      pushEvent(EventType::kStatusChanged, Status::kDisconnected);
     }
     connection_state_ = Status::kDisconnected;
     return Status::kDisconnected;
@@ -262,8 +348,9 @@ namespace vijfendertig {
   /*!
    *  \param actuator Actuator.
    *  \param action Action.
-   *  \return kConnected on success, kInvalidCommand if the given command was not valid or
-   *      kIoError on USB errors.
+   *  \return kConnected on success, kInvalidCommand if the given command was not valid,
+   *      kEmergencyStop if the emergency stop is engaged, kLeaseConflict if the actuator is
+   *      leased (see RoboticArmLease) or kIoError on USB errors.
    */
   RoboticArmUsb::Status RoboticArmUsb::sendCommand(
       RoboticArmUsb::Actuator actuator, RoboticArmUsb::Action action)
@@ -272,14 +359,33 @@ namespace vijfendertig {
     if(!isCommandValid(actuator, action)) {
       return Status::kInvalidCommand;
     }
+    else if(emergency_stop_) {
+      return Status::kEmergencyStop;
+    }
+    else if((lease_mask_ & getActuatorMask(actuator)) != 0) {
+      return Status::kLeaseConflict;
+    }
     else {
-      std::lock_guard<std::mutex> lock{serialise_mutex_};
+      RoboticArmTrace::Span trace{"sendCommand"};
+      std::unique_lock<std::mutex> lock{serialise_mutex_, std::defer_lock};
+      { // Trace scope.
+        RoboticArmTrace::Span trace{"sendCommand: lock serialise_mutex_"};
+        lock.lock();
+      }
       if(connection_state_ == Status::kConnected) {
         // Get lock, update command state and notify control thread.
-        std::lock_guard<std::mutex> lock{control_pending_mutex_};
+        std::unique_lock<std::mutex> lock{control_pending_mutex_, std::defer_lock};
+        { // Trace scope.
+          RoboticArmTrace::Span trace{"sendCommand: lock control_pending_mutex_"};
+          lock.lock();
+        }
+        if(emergency_stop_) {
+          return Status::kEmergencyStop;
+        }
         command_state_ &= ~(0x03 << uint8_t(actuator));
         command_state_ |= uint8_t(action) << uint8_t(actuator);
-        control_pending_.notify_all();
+        countCommand();
+        notifyControlThread();
       }
       return connection_state_;
     }
@@ -289,7 +395,8 @@ namespace vijfendertig {
   /*!
    *  \param commands Composite (actuator/action) command.
    *  \return kConnected on success, kInvalidCommand if at least one of the given commands was not
-   *      valid or kIoError on USB errors.
+   *      valid, kEmergencyStop if the emergency stop is engaged, kLeaseConflict if one of the
+   *      actuators is leased (see RoboticArmLease) or kIoError on USB errors.
    */
   RoboticArmUsb::Status RoboticArmUsb::sendCommand(
       const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands)
@@ -298,16 +405,35 @@ namespace vijfendertig {
     if(!isCommandValid(commands)) {
       return Status::kInvalidCommand;
     }
+    else if(emergency_stop_) {
+      return Status::kEmergencyStop;
+    }
+    else if(std::any_of(commands.begin(), commands.end(),
+          [this](const std::pair<Actuator, Action> & command) {
+            return (lease_mask_ & getActuatorMask(command.first)) != 0;
+          })) {
+      return Status::kLeaseConflict;
+    }
     else {
-      std::lock_guard<std::mutex> lock{serialise_mutex_};
+      RoboticArmTrace::Span trace{"sendCommand"};
+      std::unique_lock<std::mutex> lock{serialise_mutex_, std::defer_lock};
+      { // Trace scope.
+        RoboticArmTrace::Span trace{"sendCommand: lock serialise_mutex_"};
+        lock.lock();
+      }
       if(connection_state_ == Status::kConnected) {
         // Get lock, update command state and notify control thread.
-        std::lock_guard<std::mutex> lock{control_pending_mutex_};
-        for(const auto & command: commands) {
-          command_state_ &= ~(0x03 << uint8_t(command.first));
-          command_state_ |= uint8_t(command.second) << uint8_t(command.first);
+        std::unique_lock<std::mutex> lock{control_pending_mutex_, std::defer_lock};
+        { // Trace scope.
+          RoboticArmTrace::Span trace{"sendCommand: lock control_pending_mutex_"};
+          lock.lock();
         }
-        control_pending_.notify_all();
+        if(emergency_stop_) {
+          return Status::kEmergencyStop;
+        }
+        command_state_ = updateCommandState(command_state_, commands);
+        countCommand();
+        notifyControlThread();
       }
       return connection_state_;
     }
@@ -315,21 +441,513 @@ namespace vijfendertig {
 
   //! Send a stop command to the robotic arm's interface.
   /*!
+   *  Leased actuators are controlled by their lease only, so they're not stopped (use the
+   *  emergency stop to stop everything). With a motor budget, the run time still owed to the
+   *  stopped actuators is discarded, so they stop right away (unlike after a command which stops
+   *  a single actuator, see setMotorBudget()).
+   *
    *  \return kConnected on success or kIoError on USB errors.
    */
   RoboticArmUsb::Status RoboticArmUsb::sendStop()
   {
     Command command_state_stop = 0;
+    RoboticArmTrace::Span trace{"sendStop"};
     std::lock_guard<std::mutex> lock{serialise_mutex_};
-    if(connection_state_ == Status::kConnected && command_state_ != command_state_stop) {
+    if(connection_state_ == Status::kConnected) {
       // Get lock, update command state and notify control thread.
       std::lock_guard<std::mutex> lock{control_pending_mutex_};
-      command_state_ = command_state_stop;
-      control_pending_.notify_all();
+      bool owed = !isMotorBacklogEmpty();
+      clearMotorBacklog(~ Command(lease_mask_));
+      if(command_state_ != command_state_stop || owed) {
+        command_state_ = command_state_stop;
+        countCommand();
+        notifyControlThread();
+      }
+    }
+    return connection_state_;
+  }
+
+  //! Engage the emergency stop.
+  /*!
+   *  This function doesn't take the mutexes used by connect(), disconnect() and the other
+   *  commands before the stop command is sent. It latches the emergency stop and sends a stop
+   *  command to the USB interface itself, as soon as the USB transfer in flight (if any) is
+   *  finished. Afterwards, the queued and running commands are discarded (so releasing the
+   *  emergency stop doesn't restart any actuator) and all further commands are rejected with
+   *  kEmergencyStop until
+   *  releaseEmergencyStop() is called, so running motions (like RoboticArmMotion::play()) are
+   *  aborted as well. The latency from this call until the stop command's USB transfer is
+   *  completed is recorded (see getEmergencyStopStatistics()). While disconnected, no stop
+   *  command is sent and nothing is recorded.
+   */
+  void RoboticArmUsb::emergencyStop()
+  {
+    int64_t requested = std::max<int64_t>(1, std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now().time_since_epoch()).count());
+    emergency_stop_ = true;
+    int64_t pending{0};
+    emergency_stop_requested_.compare_exchange_strong(pending, requested);
+    { // lock_guard scope.
+      RoboticArmTrace::Span trace{"emergencyStop"};
+      std::lock_guard<std::mutex> lock{transfer_mutex_};
+      if(!transfer_ready_) {
+        // Nothing to stop without a connection. Don't leave the request pending, or the next
+        // connect() would record the disconnected period as the emergency stop's latency.
+        emergency_stop_requested_ = 0;
+      }
+      else if(transferCommandState(0) == Status::kConnected) {
+        int64_t completed = emergency_stop_requested_.exchange(0);
+        if(completed != 0) {
+          completeEmergencyStop(completed);
+        }
+      }
+    }
+    // Queued after the stop command, so it doesn't add to the emergency stop's latency.
+    pushEvent(EventType::kEmergencyStop, Status::kEmergencyStop);
+    { // lock_guard scope.
+      // The actuators are stopped now: discard their command states and owed run time, so the
+      // next command after releaseEmergencyStop() only starts what it asks for. If the stop
+      // command wasn't sent, the control thread retries it (the request is still pending).
+      std::lock_guard<std::mutex> lock{control_pending_mutex_};
+      command_state_ = 0;
+      leased_command_state_ = 0;
+      clearMotorBacklog();
+      command_state_sent_ = 0;
     }
+    // Let the control thread retry the stop command if it wasn't sent. Every transfer checks the
+    // emergency stop, so a lost notification can't restart the actuators.
+    control_pending_.notify_all();
+  }
+
+  //! Release the emergency stop.
+  /*!
+   *  The actuators remain stopped, but new commands are accepted again.
+   *
+   *  \return Current connection state.
+   */
+  RoboticArmUsb::Status RoboticArmUsb::releaseEmergencyStop()
+  {
+    std::lock_guard<std::mutex> lock{serialise_mutex_};
+    std::lock_guard<std::mutex> control_lock{control_pending_mutex_};
+    // The control thread may not have seen the emergency stop yet, so discard the owed run time
+    // here as well: the actuators must remain stopped.
+    clearMotorBacklog();
+    emergency_stop_ = false;
     return connection_state_;
   }
 
+  //! Check whether the emergency stop is engaged.
+  /*!
+   *  \return True if the emergency stop is engaged, false if not.
+   */
+  bool RoboticArmUsb::isEmergencyStopped() const
+  {
+    return emergency_stop_;
+  }
+
+  //! Get the emergency stop statistics.
+  /*!
+   *  \return Number of emergency stops sent and their latencies.
+   */
+  RoboticArmUsb::EmergencyStopStatistics RoboticArmUsb::getEmergencyStopStatistics() const
+  {
+    return EmergencyStopStatistics{emergency_stop_count_,
+      std::chrono::nanoseconds{emergency_stop_last_latency_},
+      std::chrono::nanoseconds{emergency_stop_max_latency_}};
+  }
+
+  //! Mark the current pose of the robotic arm as its home.
+  /*!
+   *  From now on, every command word transferred to the USB interface is journaled with its
+   *  time, so returnHome() can drive the arm back to this pose. The journal is allocated here
+   *  and never grows: when it's full, journaling stops and returnHome() fails with kHomeLost
+   *  (until the home is marked again). A previous home mark is discarded.
+   *
+   *  \param journal_capacity Maximum number of journaled command word transitions.
+   *  \throws std::invalid_argument if the capacity is zero.
+   */
+  void RoboticArmUsb::markHome(std::size_t journal_capacity)
+  {
+    if(journal_capacity == 0) {
+      throw std::invalid_argument("Invalid journal capacity for the robotic arm");
+    }
+    // Allocate outside the transfer mutex, which the emergency stop needs.
+    std::vector<JournalEntry> journal;
+    journal.reserve(journal_capacity);
+    std::lock_guard<std::mutex> lock{transfer_mutex_};
+    journal.push_back(JournalEntry{clock_->now(),
+        statistics_command_state_.load(std::memory_order_relaxed)});
+    journal_.swap(journal);
+    journal_capacity_ = journal_capacity;
+    journal_overflow_ = false;
+  }
+
+  //! Drive the robotic arm back to the pose marked by markHome().
+  /*!
+   *  This function stops the actuators and replays the journal backwards: every run of a motor
+   *  since the home mark becomes a step in the opposite direction with the same duration, in
+   *  reverse order. Runs which overlapped in time still overlap, pauses in between are left out
+   *  (see RoboticArmMotion::optimise()). The light is left as it is. It blocks until the arm is
+   *  back (see RoboticArmMotion::play()) and marks the home again afterwards, with the same
+   *  journal capacity.
+   *
+   *  The arm has no position feedback, so the accuracy depends on the motors running equally
+   *  fast in both directions. Leased actuators (see RoboticArmLease) are journaled as well, but
+   *  the return fails with kLeaseConflict if they're still leased.
+   *
+   *  \return kConnected on success, kHomeLost if no home is marked or the journal overflowed,
+   *      or the status of the failing command otherwise (the home is lost in that case).
+   */
+  RoboticArmUsb::Status RoboticArmUsb::returnHome()
+  {
+    // This also discards the run time owed with a motor budget, which would otherwise run after
+    // the journal is taken (without being journaled, so without being reversed).
+    Status status = sendStop();
+    if(status != Status::kConnected) {
+      return status;
+    }
+    // Take the journal, which also pauses journaling while the return is playing.
+    std::vector<JournalEntry> journal;
+    std::size_t journal_capacity;
+    RoboticArmClock::TimePoint end;
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> lock{transfer_mutex_};
+      if(journal_capacity_ == 0 || journal_overflow_) {
+        return Status::kHomeLost;
+      }
+      journal.swap(journal_);
+      journal_capacity = journal_capacity_;
+      journal_capacity_ = 0;
+      end = clock_->now();
+    }
+    // Collect the runs of the motors (the time between starting and stopping or reversing).
+    struct Run {
+      RoboticArmClock::TimePoint start;
+      RoboticArmClock::TimePoint end;
+      Actuator actuator;
+      Action action;
+    };
+    std::vector<Run> runs;
+    const std::array<Actuator, 5> motors{{Actuator::kGripper, Actuator::kWrist,
+      Actuator::kElbow, Actuator::kShoulder, Actuator::kBase}};
+    for(auto actuator: motors) {
+      Command action{0};
+      RoboticArmClock::TimePoint start{};
+      for(const auto & entry: journal) {
+        Command entry_action = (entry.command_state >> uint8_t(actuator)) & 0x03;
+        if(entry_action != action) {
+          if(action != 0) {
+            runs.push_back(Run{start, entry.time, actuator, Action(action)});
+          }
+          action = entry_action;
+          start = entry.time;
+        }
+      }
+      if(action != 0) {
+        runs.push_back(Run{start, end, actuator, Action(action)});
+      }
+    }
+    // Reverse the time: the last run to finish is the first one to undo.
+    std::stable_sort(runs.begin(), runs.end(), [](const Run & a, const Run & b) {
+        return a.end > b.end;
+      });
+    // Steps on the same motor keep their order (see RoboticArmMotion::optimise()). A step only
+    // waits for the last reversed run of every other motor which finished before it started,
+    // all earlier ones are implied.
+    RoboticArmMotion::Sequence sequence;
+    std::map<Actuator, std::vector<std::size_t>> motor_steps;
+    std::map<Actuator, std::size_t> motor_finished;
+    for(std::size_t step = 0; step < runs.size(); ++ step) {
+      const Run & run = runs[step];
+      std::vector<std::size_t> dependencies;
+      for(auto & steps: motor_steps) {
+        std::size_t & finished = motor_finished[steps.first];
+        // Reversed, a run finishes before another one starts if it started after the other one
+        // ended.
+        while(finished < steps.second.size() && runs[steps.second[finished]].start >= run.end) {
+          ++ finished;
+        }
+        if(steps.first != run.actuator && finished > 0) {
+          dependencies.push_back(steps.second[finished - 1]);
+        }
+      }
+      motor_steps[run.actuator].push_back(step);
+      sequence.push_back(RoboticArmMotion::Step{run.actuator, Action(3 - uint8_t(run.action)),
+          std::chrono::duration_cast<RoboticArmMotion::Duration>(
+            run.end - run.start + std::chrono::microseconds{500}), dependencies});
+    }
+    status = RoboticArmMotion::play(*this, RoboticArmMotion::optimise(sequence));
+    if(status == Status::kConnected) {
+      markHome(journal_capacity);
+    }
+    return status;
+  }
+
+  //! Limit the number of simultaneously running motors.
+  /*!
+   *  Every actuator has a weight (1 for the motors and 0 for the light by default, see
+   *  setMotorWeight()), so the budget is the maximum number of running motors, or the maximum
+   *  current in the units of the weights. While the requested actuators exceed the budget, the
+   *  control thread multiplexes them in time slices: every slice, it lets the requested actuators
+   *  run in round-robin order until the budget is used, and stops the others. A single actuator
+   *  exceeding the budget on its own still runs, but alone.
+   *
+   *  The arm has no encoders, so a motion is defined by how long its actuators run. Every
+   *  actuator therefore gets the full run time it was requested for: the time it waits is owed
+   *  to it and queued (per direction, in order), and it keeps running after its request stopped
+   *  until the owed time is delivered. Timed motions take longer, but end in the same pose.
+   *  RoboticArmMotion::play() waits for the owed run time (see waitForMotors()). sendStop() and
+   *  the emergency stop discard it, so they still stop the actuators right away. The scheduler's
+   *  statistics show the delays (see getMotorStatistics()).
+   *
+   *  \param budget Maximum total weight of the running actuators (0 for no limit).
+   *  \param quantum Time slice.
+   *  \throws std::invalid_argument if the time slice is not positive.
+   */
+  void RoboticArmUsb::setMotorBudget(unsigned budget, RoboticArmClock::Duration quantum)
+  {
+    if(quantum <= RoboticArmClock::Duration::zero()) {
+      throw std::invalid_argument("Invalid motor scheduler time slice for the robotic arm");
+    }
+    std::lock_guard<std::mutex> lock{control_pending_mutex_};
+    if(!motor_scheduling_) {
+      motor_accounted_ = clock_->now();
+      motor_requested_ = 0;
+      motor_demanded_ = 0;
+      motor_running_ = 0;
+    }
+    motor_budget_ = budget;
+    motor_quantum_ = quantum;
+    motor_scheduling_ = true;
+    // Let the control thread reschedule right away, starting a new time slice.
+    motor_granted_ = 0;
+    motor_slice_end_ = RoboticArmClock::TimePoint::min();
+    motor_deadline_ = RoboticArmClock::TimePoint::min();
+    notifyControlThread();
+  }
+
+  //! Set the weight of an actuator for the motor budget (see setMotorBudget()).
+  /*!
+   *  \param actuator Actuator.
+   *  \param weight Weight (its current draw for example, 0 if it doesn't count).
+   *  \throws std::invalid_argument if the actuator is not valid.
+   */
+  void RoboticArmUsb::setMotorWeight(Actuator actuator, unsigned weight)
+  {
+    if(!isCommandValid(actuator, Action(0))) {
+      throw std::invalid_argument("Invalid actuator for the robotic arm's motor scheduler");
+    }
+    std::lock_guard<std::mutex> lock{control_pending_mutex_};
+    motor_weights_[actuator] = weight;
+    if(motor_scheduling_) {
+      motor_granted_ = 0;
+      motor_slice_end_ = RoboticArmClock::TimePoint::min();
+      motor_deadline_ = RoboticArmClock::TimePoint::min();
+      notifyControlThread();
+    }
+  }
+
+  //! Get the motor scheduler statistics.
+  /*!
+   *  The statistics are only updated while a motor budget is set (or run time is owed). This
+   *  function locks control_pending_mutex_, so don't poll it at a high rate.
+   *
+   *  \return Statistics of every actuator.
+   */
+  std::map<RoboticArmUsb::Actuator, RoboticArmUsb::MotorStatistics>
+    RoboticArmUsb::getMotorStatistics() const
+  {
+    std::lock_guard<std::mutex> lock{control_pending_mutex_};
+    std::map<Actuator, MotorStatistics> statistics{motor_statistics_};
+    if(motor_scheduling_) {
+      accountMotors(statistics, clock_->now() - motor_accounted_);
+    }
+    return statistics;
+  }
+
+  //! Wait until the actuators got all the run time owed to them (see setMotorBudget()).
+  /*!
+   *  Without a motor budget, this function returns immediately. While an actuator is still
+   *  requested and behind, it keeps waiting, so stop the actuators first.
+   *
+   *  \return kConnected when no run time is owed any longer, kEmergencyStop if the emergency stop
+   *      is engaged or the connection state if the robotic arm is not connected.
+   */
+  RoboticArmUsb::Status RoboticArmUsb::waitForMotors()
+  {
+    std::unique_lock<std::mutex> lock{control_pending_mutex_};
+    while(connection_state_ == Status::kConnected && !emergency_stop_ && !isMotorBacklogEmpty()) {
+      clock_->waitUntil(motor_idle_, lock, RoboticArmClock::TimePoint::max());
+    }
+    if(emergency_stop_) {
+      return Status::kEmergencyStop;
+    }
+    return connection_state_;
+  }
+
+  //! Get a snapshot of the control path statistics.
+  /*!
+   *  The statistics are kept in lock-free counters, so this function never blocks the control
+   *  path and can be polled at a fixed rate (by a user interface for example). The counters are
+   *  read one by one, so a snapshot taken during a transfer can be off by one transfer. Diff two
+   *  snapshots to get rates and the latency histogram of the interval between them. The ratio of
+   *  commands to transfers shows how many commands the control thread coalesced.
+   *
+   *  \return Statistics since the creation of the robotic arm controller object.
+   */
+  RoboticArmUsb::Statistics RoboticArmUsb::getStatistics() const
+  {
+    Statistics statistics;
+    statistics.commands = statistics_commands_.load(std::memory_order_relaxed);
+    statistics.transfers = statistics_transfers_.load(std::memory_order_relaxed);
+    statistics.transfer_errors = statistics_transfer_errors_.load(std::memory_order_relaxed);
+    statistics.command_state = statistics_command_state_.load(std::memory_order_relaxed);
+    for(std::size_t bucket = 0; bucket < kLatencyBuckets; ++ bucket) {
+      statistics.transfer_latency[bucket] =
+        statistics_transfer_latency_[bucket].load(std::memory_order_relaxed);
+    }
+    return statistics;
+  }
+
+  //! Estimate a percentile of a USB transfer latency histogram.
+  /*!
+   *  \param histogram Latency histogram (of a snapshot or the difference of two snapshots).
+   *  \param percentile Percentile (between 0 and 100).
+   *  \return Upper bound of the histogram bucket containing the percentile or zero if the
+   *      histogram is empty.
+   */
+  std::chrono::microseconds RoboticArmUsb::getLatencyPercentile(
+      const LatencyHistogram & histogram, double percentile)
+  {
+    uint64_t total{0};
+    for(auto count: histogram) {
+      total += count;
+    }
+    if(total == 0) {
+      return std::chrono::microseconds{0};
+    }
+    double rank = std::min(100.0, std::max(0.0, percentile)) / 100.0 * total;
+    uint64_t cumulative{0};
+    std::size_t bucket{0};
+    for(; bucket < kLatencyBuckets - 1; ++ bucket) {
+      cumulative += histogram[bucket];
+      if(cumulative > 0 && cumulative >= rank) {
+        break;
+      }
+    }
+    return std::chrono::microseconds{int64_t(2) << bucket};
+  }
+
+  //! Get a file descriptor which is readable while events are pending.
+  /*!
+   *  The first call creates the descriptor (an eventfd on Linux, a pipe elsewhere) and starts
+   *  queueing events, so applications which don't use events don't pay for them. Add the
+   *  descriptor to an event loop (select, poll, epoll...) and call pollEvents() when it becomes
+   *  readable. Don't read from or close the descriptor; it stays valid until the robotic arm
+   *  controller object is destroyed.
+   *
+   *  \return File descriptor.
+   *  \throws std::runtime_error if the descriptor can't be created.
+   */
+  int RoboticArmUsb::getEventDescriptor()
+  {
+    std::lock_guard<std::mutex> lock{events_mutex_};
+    if(event_descriptor_ < 0) {
+#ifdef __linux__
+      event_descriptor_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      event_write_descriptor_ = event_descriptor_;
+#else
+      int descriptors[2];
+      if(pipe(descriptors) == 0) {
+        for(auto descriptor: descriptors) {
+          fcntl(descriptor, F_SETFL, fcntl(descriptor, F_GETFL) | O_NONBLOCK);
+          fcntl(descriptor, F_SETFD, FD_CLOEXEC);
+        }
+        event_descriptor_ = descriptors[0];
+        event_write_descriptor_ = descriptors[1];
+      }
+#endif
+      if(event_descriptor_ < 0) {
+        std::string message{"An error occured while creating the robotic arm's event descriptor: "
+          + std::string(std::strerror(errno))};
+        std::cerr << message << "." << std::endl;
+        throw std::runtime_error(message);
+      }
+      events_enabled_ = true;
+    }
+    return event_descriptor_;
+  }
+
+  //! Get all pending events without blocking.
+  /*!
+   *  Events are status changes (connect(), disconnect() and I/O errors), completed USB transfers,
+   *  emergency stops and watchdog events for USB transfers which took longer than the watchdog
+   *  timeout. The event descriptor is no longer readable afterwards (until the next event).
+   *
+   *  \return Pending events, oldest first (empty if there are none).
+   */
+  std::vector<RoboticArmUsb::Event> RoboticArmUsb::pollEvents()
+  {
+    std::lock_guard<std::mutex> lock{events_mutex_};
+    if(event_descriptor_ >= 0 && !events_.empty()) {
+      // Reset the descriptor's readiness: it was signalled when the queue became non-empty.
+#ifdef __linux__
+      uint64_t counter;
+      while(read(event_descriptor_, &counter, sizeof(counter)) < 0 && errno == EINTR) {
+      }
+#else
+      char buffer[16];
+      while(read(event_descriptor_, buffer, sizeof(buffer)) > 0) {
+      }
+#endif
+    }
+    std::vector<Event> events{events_.begin(), events_.end()};
+    events_.clear();
+    return events;
+  }
+
+  //! Get the number of events dropped because the event queue was full.
+  /*!
+   *  The queue holds up to 1024 events. When it's full, the oldest event is dropped.
+   *
+   *  \return Number of dropped events.
+   */
+  uint64_t RoboticArmUsb::getDroppedEventCount() const
+  {
+    std::lock_guard<std::mutex> lock{events_mutex_};
+    return events_dropped_;
+  }
+
+  //! Set the watchdog timeout for USB transfers.
+  /*!
+   *  A USB transfer which takes longer than this timeout generates a kWatchdog event (after the
+   *  transfer completed), to detect a degrading USB link. The default timeout is 50 ms. A hung
+   *  transfer only completes (and generates a kWatchdog event) when it times out, see
+   *  setTransferTimeout().
+   *
+   *  \param timeout Watchdog timeout.
+   */
+  void RoboticArmUsb::setWatchdogTimeout(std::chrono::nanoseconds timeout)
+  {
+    watchdog_timeout_ = timeout.count();
+  }
+
+  //! Set the timeout for USB transfers.
+  /*!
+   *  A USB transfer which doesn't complete within this timeout is aborted. It fails with
+   *  kIoError, which disconnects the robotic arm like any other USB error. The default timeout is
+   *  1 s. It's rounded up to whole milliseconds and extended to just after the watchdog timeout
+   *  if that's longer, so an aborted transfer always generates a kWatchdog event. A timeout of 0
+   *  disables it: a hung transfer then blocks the control thread (and the emergency stop)
+   *  forever, without any watchdog event.
+   *
+   *  \param timeout Transfer timeout (0 for none).
+   */
+  void RoboticArmUsb::setTransferTimeout(std::chrono::nanoseconds timeout)
+  {
+    transfer_timeout_ = timeout.count();
+  }
+
   //! Get the current status of the robotic arm's control object.
   /*!
    *  \return kDisconnected, kConnecting, kConnected, kIoError or kDisconnected, depending on the
@@ -341,6 +959,24 @@ namespace vijfendertig {
     return connection_state_;
   }
 
+  //! Get the clock used by the robotic arm's control object.
+  /*!
+   *  \return Clock for all timed behaviour (the system clock, unless another one was injected).
+   */
+  RoboticArmClock & RoboticArmUsb::getClock() const
+  {
+    return *clock_;
+  }
+
+  //! Get the motor odometer of the robotic arm.
+  /*!
+   *  \return Odometer, updated with every command word sent to the robotic arm.
+   */
+  RoboticArmOdometer & RoboticArmUsb::getOdometer() const
+  {
+    return *odometer_;
+  }
+
   //! Translate a status code to a human readable status string.
   /*!
    *  \param status Status code to translate.
@@ -357,42 +993,544 @@ namespace vijfendertig {
       case Status::kDeviceNotFound: return "device not found";
       case Status::kConnectionFailed: return "connection failed";
       case Status::kInvalidCommand: return "invalid command";
+      case Status::kEmergencyStop: return "emergency stop";
+      case Status::kLeaseConflict: return "lease conflict";
+      case Status::kHomeLost: return "home lost";
       default: return "other error";
     }
   }
 
+  //! Create a rendezvous for a group command.
+  /*!
+   *  \param count Number of control threads taking part.
+   */
+  RoboticArmUsb::GroupRendezvous::GroupRendezvous(std::size_t count):
+    count{count},
+    deadline{std::chrono::steady_clock::now() + std::chrono::nanoseconds{group_timeout_}},
+    arrived{0},
+    submitted(count),
+    completed(count),
+    finished_count{0},
+    finished_arms(count, false),
+    abandoned{false}
+  {}
+
+  //! Apply a composite command to a raw command state.
+  /*!
+   *  \param command_state Raw command state.
+   *  \param commands Composite (actuator/action) command (must be valid).
+   *  \return Updated raw command state.
+   */
+  RoboticArmUsb::Command RoboticArmUsb::updateCommandState(Command command_state,
+      const std::map<RoboticArmUsb::Actuator, RoboticArmUsb::Action> & commands)
+  {
+    for(const auto & command: commands) {
+      command_state &= ~(0x03 << uint8_t(command.first));
+      command_state |= uint8_t(command.second) << uint8_t(command.first);
+    }
+    return command_state;
+  }
+
   //! Control thread.
   void RoboticArmUsb::controlThread()
   {
     Status connection_state_current{Status::kConnecting};
-    Command command_state_current{0};
+    Command command_state_requested{0};
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> lock{transfer_mutex_};
+      transfer_ready_ = true;
+    }
     // Stop device prior to entering the control loop.
     { // lock_guard scope.
       std::lock_guard<std::mutex> lock{initialisation_finished_mutex_};
       command_state_ = 0;
+      leased_command_state_ = 0;
+      int64_t emergency_stop_requested = emergency_stop_requested_.exchange(0);
       connection_state_ = sendCommandState(command_state_);
+      if(emergency_stop_requested != 0) {
+        completeEmergencyStop(emergency_stop_requested);
+      }
       connection_state_current = connection_state_;
-      command_state_current = command_state_;
+      { // lock_guard scope.
+        std::lock_guard<std::mutex> control_lock{control_pending_mutex_};
+        command_state_sent_ = command_state_;
+      }
       initialisation_finished_.notify_all();
     }
     // Control loop. Process new commands as they are generated by other threads.
     do {
       std::unique_lock<std::mutex> lock(control_pending_mutex_);
-      control_pending_.wait(lock,
-          [this, connection_state_current, command_state_current]
-          {return connection_state_current != connection_state_
-                  || command_state_current != command_state_;});
-      if(command_state_ != command_state_current && connection_state_ == Status::kConnected) {
-        connection_state_ = sendCommandState(command_state_);
-      }
-      command_state_current = command_state_;
+      // Leased commands don't lock control_pending_mutex_ and only notify this thread while it's
+      // waiting (see wakeControlThread()), so announce that before checking the command state.
+      control_waiting_ = true;
+      // The motor scheduler's time slices end at motor_deadline_.
+      while(connection_state_current == connection_state_
+          && command_state_requested == getEffectiveCommandState() && !group_rendezvous_
+          && emergency_stop_requested_ == 0
+          && (motor_deadline_ == RoboticArmClock::TimePoint::max()
+            || clock_->now() < motor_deadline_)) {
+        clock_->waitUntil(control_pending_, lock, motor_deadline_);
+      }
+      control_waiting_ = false;
+      if(control_notified_ != RoboticArmTrace::Clock::time_point{}) {
+        if(RoboticArmTrace::isEnabled()) {
+          RoboticArmTrace::record(
+              "controlThread: wake-up", control_notified_, RoboticArmTrace::Clock::now());
+        }
+        control_notified_ = RoboticArmTrace::Clock::time_point{};
+      }
+      // Group commands: wait (spinning, the others are about to arrive too) until the control
+      // threads of all arms in the group are ready, so their transfers start together.
+      auto group_rendezvous = std::move(group_rendezvous_);
+      if(group_rendezvous) {
+        group_rendezvous->arrived.fetch_add(1, std::memory_order_acq_rel);
+        // Bounded, so a control thread which never arrives can't block the others forever.
+        while(group_rendezvous->arrived.load(std::memory_order_acquire)
+            < group_rendezvous->count
+            && std::chrono::steady_clock::now() < group_rendezvous->deadline) {
+          std::this_thread::yield();
+        }
+        group_rendezvous->submitted[group_index_] = std::chrono::steady_clock::now();
+        // Don't start the command of a group which gave up waiting for this thread.
+        if(group_rendezvous->abandoned.load(std::memory_order_acquire)) {
+          abandonGroupCommand();
+        }
+      }
+      // An engaged emergency stop overrides all commands. An emergency stop request which
+      // emergencyStop() couldn't send itself is sent even if the actuators are supposed to be
+      // stopped already.
+      if(emergency_stop_) {
+        command_state_ = 0;
+        leased_command_state_ = 0;
+        clearMotorBacklog();
+      }
+      command_state_requested = getEffectiveCommandState();
+      Command command_state = command_state_requested;
+      if(motor_scheduling_) {
+        command_state = scheduleMotors(command_state_requested);
+      }
+      else {
+        motor_deadline_ = RoboticArmClock::TimePoint::max();
+      }
+      int64_t emergency_stop_requested = emergency_stop_requested_.exchange(0);
+      if(emergency_stop_requested != 0 && connection_state_ == Status::kConnected) {
+        connection_state_ = sendCommandState(command_state);
+        completeEmergencyStop(emergency_stop_requested);
+      }
+      else if(command_state != command_state_sent_ && connection_state_ == Status::kConnected) {
+        connection_state_ = sendCommandState(command_state);
+      }
+      if(group_rendezvous) {
+        group_rendezvous->completed[group_index_] = std::chrono::steady_clock::now();
+        // Too late: the group gave up waiting, so stop again (in the next iteration).
+        if(finishGroupRendezvous(*group_rendezvous)) {
+          abandonGroupCommand();
+        }
+      }
+      command_state_sent_ = command_state;
       connection_state_current = connection_state_;
     } while(connection_state_current == Status::kConnected);
+    if(connection_state_current == Status::kIoError) {
+      pushEvent(EventType::kStatusChanged, Status::kIoError);
+    }
+    // Owed run time is lost with the connection.
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> lock{control_pending_mutex_};
+      clearMotorBacklog();
+    }
+    // Release a group command which arrived after the last iteration (it checks the connection
+    // state first, so this is a safety net), so the group never waits for this thread.
+    { // lock_guard scope.
+      std::lock_guard<std::mutex> lock{control_pending_mutex_};
+      auto group_rendezvous = std::move(group_rendezvous_);
+      if(group_rendezvous) {
+        group_rendezvous->arrived.fetch_add(1, std::memory_order_acq_rel);
+        group_rendezvous->submitted[group_index_] = std::chrono::steady_clock::now();
+        group_rendezvous->completed[group_index_] = group_rendezvous->submitted[group_index_];
+        finishGroupRendezvous(*group_rendezvous);
+      }
+    }
     // Stop device prior to disconnecting.
     // The connect() function only touches libusb before starting this thread, the disconnect()
-    // function only touches libusb after starting this thread and all setCommandState() calls
-    // should be done by this thread, so it's safe to reset the device without locking a mutex.
+    // function only touches libusb after stopping this thread and all other transfers (by
+    // emergencyStop()) are serialised by transfer_mutex_, so it's safe to reset the device.
     sendCommandState(0);
+    std::lock_guard<std::mutex> lock{transfer_mutex_};
+    transfer_ready_ = false;
+    // A pending emergency stop (whose stop command failed) ends with the connection, like below.
+    emergency_stop_requested_ = 0;
+    // After an I/O error, the stop command may have failed as well, so the odometer would keep
+    // the motors running. Without a connection, they're not driven any longer.
+    odometer_->update(0);
+  }
+
+  //! Apply the motor budget to a command state (see setMotorBudget()).
+  /*!
+   *  The caller must hold control_pending_mutex_. This function also updates the motor
+   *  statistics and the owed run time up to now, and sets the time to reschedule.
+   *
+   *  \param command_state Requested raw command state.
+   *  \return Raw command state with only the actuators allowed to run in the current time slice.
+   */
+  RoboticArmUsb::Command RoboticArmUsb::scheduleMotors(Command command_state)
+  {
+    static const std::array<Actuator, 6> actuators{{Actuator::kGripper, Actuator::kWrist,
+      Actuator::kElbow, Actuator::kShoulder, Actuator::kBase, Actuator::kLight}};
+    auto now = clock_->now();
+    accountMotors(motor_statistics_, now - motor_accounted_);
+    updateMotorBacklog(now - motor_accounted_);
+    motor_accounted_ = now;
+    motor_requested_ = command_state;
+    // Owed run time goes first, the current request follows.
+    Command demanded{0};
+    Command demanded_mask{0};
+    unsigned load{0};
+    for(auto actuator: actuators) {
+      Command mask = getActuatorMask(actuator);
+      const auto & backlog = motor_backlog_[actuator];
+      Command action = backlog.empty()
+        ? command_state & mask : Command(backlog.front().first) << uint8_t(actuator);
+      if(action != 0) {
+        demanded |= action;
+        demanded_mask |= mask;
+        load += motor_weights_[actuator];
+      }
+    }
+    motor_demanded_ = demanded;
+    Command granted{0};
+    if(motor_budget_ == 0 || load <= motor_budget_) {
+      granted = demanded_mask;
+      motor_slice_end_ = RoboticArmClock::TimePoint::max();
+    }
+    else {
+      // Over budget. Within a time slice, the running actuators keep running (as long as they're
+      // demanded) and only newly demanded actuators are added if the budget allows it. A new
+      // time slice starts from scratch with the next actuators in round-robin order.
+      load = 0;
+      bool rotate = motor_slice_end_ != RoboticArmClock::TimePoint::max()
+        && now >= motor_slice_end_;
+      if(rotate || motor_slice_end_ == RoboticArmClock::TimePoint::max()) {
+        motor_slice_end_ = now + motor_quantum_;
+      }
+      if(!rotate) {
+        for(auto actuator: actuators) {
+          Command mask = getActuatorMask(actuator);
+          if((motor_granted_ & mask) != 0 && (demanded_mask & mask) != 0) {
+            granted |= mask;
+            load += motor_weights_[actuator];
+          }
+        }
+      }
+      // The first actuator which doesn't fit goes first in the next time slice.
+      std::size_t next{actuators.size()};
+      for(std::size_t offset = 0; offset < actuators.size(); ++ offset) {
+        std::size_t index = (motor_next_ + offset) % actuators.size();
+        Command mask = getActuatorMask(actuators[index]);
+        unsigned weight = motor_weights_[actuators[index]];
+        if((demanded_mask & mask) == 0 || (granted & mask) != 0) {
+          continue;
+        }
+        if(load + weight <= motor_budget_ || granted == 0) {
+          granted |= mask;
+          load += weight;
+        }
+        else if(next == actuators.size()) {
+          next = index;
+        }
+      }
+      if(rotate && next != actuators.size()) {
+        motor_next_ = next;
+      }
+    }
+    motor_granted_ = granted;
+    motor_running_ = demanded & granted;
+    // Reschedule at the end of the time slice or when a running actuator delivered owed run
+    // time for an action it's no longer requested for.
+    motor_deadline_ = motor_slice_end_;
+    for(auto actuator: actuators) {
+      Command mask = getActuatorMask(actuator);
+      const auto & backlog = motor_backlog_[actuator];
+      if((motor_running_ & mask) != 0 && !backlog.empty() && (backlog.size() > 1
+            || Command(backlog.front().first) << uint8_t(actuator) != (command_state & mask))) {
+        motor_deadline_ = std::min(motor_deadline_, now + backlog.front().second);
+      }
+    }
+    if(isMotorBacklogEmpty()) {
+      motor_scheduling_ = motor_budget_ != 0;
+      motor_idle_.notify_all();
+    }
+    return motor_running_;
+  }
+
+  //! Update motor statistics with the time since their last update.
+  /*!
+   *  The caller must hold control_pending_mutex_.
+   *
+   *  \param statistics Motor statistics to update.
+   *  \param elapsed Time since the last update.
+   */
+  void RoboticArmUsb::accountMotors(std::map<Actuator, MotorStatistics> & statistics,
+      RoboticArmClock::Duration elapsed) const
+  {
+    for(auto & actuator_statistics: statistics) {
+      Command mask = getActuatorMask(actuator_statistics.first);
+      MotorStatistics & motor = actuator_statistics.second;
+      if((motor_requested_ & mask) != 0) {
+        motor.requested += elapsed;
+      }
+      if((motor_running_ & mask) != 0) {
+        motor.running += elapsed;
+      }
+      if((motor_demanded_ & mask) != 0 && (motor_running_ & mask) == 0) {
+        motor.current_wait += elapsed;
+        motor.max_wait = std::max(motor.max_wait, motor.current_wait);
+      }
+      else {
+        motor.current_wait = std::chrono::nanoseconds{0};
+      }
+    }
+  }
+
+  //! Update the run time owed to the actuators with the time since the last update.
+  /*!
+   *  The caller must hold control_pending_mutex_. The requested run time is appended to the
+   *  actuators' backlogs, the time they actually ran is taken from them.
+   *
+   *  \param elapsed Time since the last update.
+   */
+  void RoboticArmUsb::updateMotorBacklog(RoboticArmClock::Duration elapsed)
+  {
+    if(elapsed <= RoboticArmClock::Duration::zero()) {
+      return;
+    }
+    for(auto & actuator_backlog: motor_backlog_) {
+      uint8_t shift = uint8_t(actuator_backlog.first);
+      auto & backlog = actuator_backlog.second;
+      Action requested = Action((motor_requested_ >> shift) & 0x03);
+      Action running = Action((motor_running_ >> shift) & 0x03);
+      if(requested != Action::kStop) {
+        if(!backlog.empty() && backlog.back().first == requested) {
+          backlog.back().second += elapsed;
+        }
+        else {
+          backlog.emplace_back(requested, elapsed);
+        }
+      }
+      auto ran = elapsed;
+      while(running != Action::kStop && ran > RoboticArmClock::Duration::zero()
+          && !backlog.empty() && backlog.front().first == running) {
+        auto delivered = std::min(ran, backlog.front().second);
+        backlog.front().second -= delivered;
+        ran -= delivered;
+        if(backlog.front().second <= RoboticArmClock::Duration::zero()) {
+          backlog.pop_front();
+        }
+      }
+    }
+  }
+
+  //! Check whether run time is owed to any actuator.
+  /*!
+   *  The caller must hold control_pending_mutex_.
+   *
+   *  \return True if no run time is owed, false if it is.
+   */
+  bool RoboticArmUsb::isMotorBacklogEmpty() const
+  {
+    return std::all_of(motor_backlog_.begin(), motor_backlog_.end(),
+        [](const std::pair<const Actuator,
+            std::deque<std::pair<Action, RoboticArmClock::Duration>>> & backlog) {
+          return backlog.second.empty();
+        });
+  }
+
+  //! Discard the run time owed to the actuators (after a stop, an emergency stop or disconnecting).
+  /*!
+   *  The caller must hold control_pending_mutex_ and stop the actuators. The owed run time is
+   *  accounted up to now first (the actuators aren't requested any longer from now on), so it
+   *  doesn't come back at the next scheduling, and the control thread reschedules right away.
+   *
+   *  \param mask Packed command bits of the actuators to discard the owed run time of.
+   */
+  void RoboticArmUsb::clearMotorBacklog(Command mask)
+  {
+    if(motor_scheduling_) {
+      auto now = clock_->now();
+      accountMotors(motor_statistics_, now - motor_accounted_);
+      updateMotorBacklog(now - motor_accounted_);
+      motor_accounted_ = now;
+      motor_requested_ &= ~ mask;
+      motor_deadline_ = now;
+    }
+    for(auto & backlog: motor_backlog_) {
+      if((getActuatorMask(backlog.first) & mask) != 0) {
+        backlog.second.clear();
+      }
+    }
+    if(isMotorBacklogEmpty()) {
+      motor_scheduling_ = motor_budget_ != 0;
+      motor_idle_.notify_all();
+    }
+  }
+
+  //! Get the command state to send, combining the leased and the other actuators.
+  /*!
+   *  The caller must hold control_pending_mutex_.
+   *
+   *  \return Raw command state.
+   */
+  RoboticArmUsb::Command RoboticArmUsb::getEffectiveCommandState() const
+  {
+    Command lease_mask = lease_mask_;
+    return (command_state_ & ~lease_mask) | (leased_command_state_ & lease_mask);
+  }
+
+  //! Notify the control thread of a new command or connection state.
+  /*!
+   *  The caller must hold control_pending_mutex_. While tracing, the notification time is kept
+   *  so the control thread can record its wake-up latency.
+   */
+  void RoboticArmUsb::notifyControlThread()
+  {
+    if(RoboticArmTrace::isEnabled()) {
+      control_notified_ = RoboticArmTrace::Clock::now();
+    }
+    control_pending_.notify_all();
+  }
+
+  //! Notify the control thread of a new leased command (without holding control_pending_mutex_).
+  /*!
+   *  The control thread sets control_waiting_ before checking the command state, and this
+   *  function checks control_waiting_ after the command state was changed (both sequentially
+   *  consistent), so either the control thread sees the new command state or this function sees
+   *  it waiting. Only in the latter case, the mutex is locked (to make sure the control thread is
+   *  really waiting) before notifying it. While the control thread is busy, leased commands don't
+   *  touch the mutex at all.
+   */
+  void RoboticArmUsb::wakeControlThread()
+  {
+    if(control_waiting_) {
+      std::lock_guard<std::mutex> lock{control_pending_mutex_};
+      notifyControlThread();
+    }
+  }
+
+  //! Lease actuators (see RoboticArmLease).
+  /*!
+   *  \param mask Packed command bits of the actuators to lease.
+   *  \return True on success, false if one of the actuators is leased already.
+   */
+  bool RoboticArmUsb::acquireLease(Command mask)
+  {
+    Command lease_mask = lease_mask_;
+    do {
+      if((lease_mask & mask) != 0) {
+        return false;
+      }
+    } while(!lease_mask_.compare_exchange_weak(lease_mask, lease_mask | mask));
+    // The leased actuators start stopped (their leased command state is cleared on release).
+    wakeControlThread();
+    return true;
+  }
+
+  //! Stop and release leased actuators (see RoboticArmLease).
+  /*!
+   *  Unlike acquiring a lease, releasing it locks control_pending_mutex_: commands given for the
+   *  actuators before they were leased are cleared, so they don't restart the actuators.
+   *
+   *  \param mask Packed command bits of the actuators to release.
+   */
+  void RoboticArmUsb::releaseLease(Command mask)
+  {
+    leased_command_state_.fetch_and(~mask);
+    std::lock_guard<std::mutex> lock{control_pending_mutex_};
+    command_state_ &= ~mask;
+    lease_mask_.fetch_and(~mask);
+    notifyControlThread();
+  }
+
+  //! Send a command to leased actuators (see RoboticArmLease).
+  /*!
+   *  The command state is updated with a lock-free compare and swap, so clients leasing
+   *  different actuators don't wait on each other.
+   *
+   *  \param lease Packed command bits of the lease's actuators.
+   *  \param mask Packed command bits of the actuators to command.
+   *  \param command_state Raw command state of the actuators to command.
+   *  \return kConnected on success, kLeaseConflict if the actuators aren't part of the lease,
+   *      kEmergencyStop if the emergency stop is engaged (and the command doesn't stop the
+   *      actuators) or the connection state if not connected.
+   */
+  RoboticArmUsb::Status RoboticArmUsb::sendLeasedCommand(
+      Command lease, Command mask, Command command_state)
+  {
+    if((mask & ~lease) != 0) {
+      return Status::kLeaseConflict;
+    }
+    else if(command_state != 0 && emergency_stop_) {
+      return Status::kEmergencyStop;
+    }
+    Status connection_state = connection_state_;
+    if(connection_state != Status::kConnected) {
+      return connection_state;
+    }
+    RoboticArmTrace::Span trace{"sendLeasedCommand"};
+    Command leased_command_state = leased_command_state_;
+    while(!leased_command_state_.compare_exchange_weak(
+          leased_command_state, (leased_command_state & ~mask) | command_state)) {
+    }
+    if(command_state != 0 && emergency_stop_) {
+      // The emergency stop was engaged during the update, which might have cleared the command
+      // state before it, so stop the actuators again.
+      leased_command_state_.fetch_and(~mask);
+      wakeControlThread();
+      return Status::kEmergencyStop;
+    }
+    countCommand();
+    wakeControlThread();
+    return Status::kConnected;
+  }
+
+  //! Record the latency of a completed emergency stop.
+  /*!
+   *  \param requested Steady clock time (in ns) of the emergency stop request.
+   */
+  void RoboticArmUsb::completeEmergencyStop(int64_t requested)
+  {
+    int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() - requested;
+    ++ emergency_stop_count_;
+    emergency_stop_last_latency_ = latency;
+    int64_t max_latency = emergency_stop_max_latency_;
+    while(latency > max_latency
+        && !emergency_stop_max_latency_.compare_exchange_weak(max_latency, latency)) {
+    }
+  }
+
+  //! Report this control thread's part of a group command as finished.
+  /*!
+   *  \param group_rendezvous Rendezvous of the group command.
+   *  \return True if the group already gave up waiting for this control thread.
+   */
+  bool RoboticArmUsb::finishGroupRendezvous(GroupRendezvous & group_rendezvous)
+  {
+    std::lock_guard<std::mutex> lock{group_rendezvous.finished_mutex};
+    ++ group_rendezvous.finished_count;
+    group_rendezvous.finished_arms[group_index_] = true;
+    group_rendezvous.finished.notify_all();
+    return group_rendezvous.abandoned;
+  }
+
+  //! Stop the actuators after a failed group command.
+  /*!
+   *  Stops all actuators which aren't leased and discards their owed run time, like sendStop().
+   *  The caller must hold control_pending_mutex_ and notify the control thread (unless it's the
+   *  control thread itself).
+   */
+  void RoboticArmUsb::abandonGroupCommand()
+  {
+    command_state_ = 0;
+    clearMotorBacklog(~ Command(lease_mask_));
   }
 
   //! Send a raw command to the robotic arm's USB interface.
@@ -406,8 +1544,44 @@ namespace vijfendertig {
    */
   RoboticArmUsb::Status RoboticArmUsb::sendCommandState(Command command_state)
   {
+    std::lock_guard<std::mutex> lock{transfer_mutex_};
+    // Checked while holding the transfer mutex, so no command can follow an emergency stop.
+    if(emergency_stop_) {
+      command_state = 0;
+    }
+    return transferCommandState(command_state);
+  }
+
+  //! Transfer a raw command to the robotic arm's USB interface.
+  /*!
+   *  The caller must hold transfer_mutex_.
+   *
+   *  \param command_state Raw command to send to the USB interface.
+   *  \return kConnected on success or kIoError on failure.
+   */
+  RoboticArmUsb::Status RoboticArmUsb::transferCommandState(Command command_state)
+  {
+    RoboticArmTrace::Span trace{"libusb_control_transfer"};
+    // Abort a hung transfer (libusb's timeout is in ms and 0 means forever), but never before the
+    // watchdog timeout, so an aborted transfer still raises a watchdog event.
+    int64_t timeout = transfer_timeout_.load(std::memory_order_relaxed);
+    if(timeout != 0) {
+      timeout = std::max(timeout, watchdog_timeout_.load(std::memory_order_relaxed)) / 1000000 + 1;
+    }
+    auto start = std::chrono::steady_clock::now();
     int error = libusb_control_transfer(libusb_device_handle_, 0x40, 0x06, 0x100, 0,
-        (uint8_t *)&command_state, sizeof(command_state), 0);
+        (uint8_t *)&command_state, sizeof(command_state),
+        static_cast<unsigned int>(std::min<int64_t>(timeout, UINT_MAX)));
+    // Only this function (serialised by transfer_mutex_) writes the transfer statistics.
+    auto duration = std::chrono::steady_clock::now() - start;
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    std::size_t bucket{0};
+    while(bucket < kLatencyBuckets - 1 && (latency >> (bucket + 1)) != 0) {
+      ++ bucket;
+    }
+    statistics_transfer_latency_[bucket].fetch_add(1, std::memory_order_relaxed);
+    statistics_transfers_.fetch_add(1, std::memory_order_relaxed);
+    statistics_command_state_.store(command_state, std::memory_order_relaxed);
     if(error != sizeof(command_state)) {
       if(error < 0) {
         std::string message{"An error occured while sending a command to the robotic arm: "
@@ -421,9 +1595,79 @@ namespace vijfendertig {
           + std::to_string(sizeof(command_state)) + " bytes sent"};
         std::cerr << message << "." << std::endl;
       }
-      return Status::kIoError;
+      statistics_transfer_errors_.fetch_add(1, std::memory_order_relaxed);
     }
-    return Status::kConnected;
+    Status status = error == sizeof(command_state) ? Status::kConnected : Status::kIoError;
+    if(status == Status::kConnected) {
+      odometer_->update(command_state);
+      // Journal the transitions since the home mark (the journal never reallocates).
+      if(journal_capacity_ != 0 && !journal_overflow_
+          && command_state != journal_.back().command_state) {
+        if(journal_.size() < journal_capacity_) {
+          journal_.push_back(JournalEntry{clock_->now(), command_state});
+        }
+        else {
+          journal_overflow_ = true;
+        }
+      }
+    }
+    if(events_enabled_) {
+      pushEvent(EventType::kTransferCompleted, status, command_state, duration);
+      if(duration > std::chrono::nanoseconds{watchdog_timeout_.load(std::memory_order_relaxed)}) {
+        pushEvent(EventType::kWatchdog, status, command_state, duration);
+      }
+    }
+    return status;
+  }
+
+  //! Get the packed command bits of an actuator.
+  /*!
+   *  \param actuator Actuator.
+   *  \return Mask of the actuator's bits in the raw command state.
+   */
+  RoboticArmUsb::Command RoboticArmUsb::getActuatorMask(Actuator actuator)
+  {
+    return Command(0x03) << uint8_t(actuator);
+  }
+
+  //! Queue an event and signal the event descriptor.
+  /*!
+   *  Events are only queued after getEventDescriptor() was called. The event descriptor is only
+   *  signalled when the queue becomes non-empty, so bursts of events cost a single write.
+   *
+   *  \param type Event type.
+   *  \param status New connection state or transfer result.
+   *  \param command_state Raw command word (of a transfer).
+   *  \param latency Duration (of a transfer).
+   */
+  void RoboticArmUsb::pushEvent(EventType type, Status status, Command command_state,
+      std::chrono::nanoseconds latency)
+  {
+    if(!events_enabled_) {
+      return;
+    }
+    Event event{type, status, command_state, std::chrono::steady_clock::now(), latency};
+    std::lock_guard<std::mutex> lock{events_mutex_};
+    if(events_.size() >= event_queue_capacity_) {
+      events_.pop_front();
+      ++ events_dropped_;
+    }
+    events_.push_back(event);
+    if(events_.size() == 1) {
+#ifdef __linux__
+      uint64_t counter{1};
+#else
+      char counter{1};
+#endif
+      while(write(event_write_descriptor_, &counter, sizeof(counter)) < 0 && errno == EINTR) {
+      }
+    }
+  }
+
+  //! Count an accepted command in the statistics.
+  void RoboticArmUsb::countCommand()
+  {
+    statistics_commands_.fetch_add(1, std::memory_order_relaxed);
   }
 
 }